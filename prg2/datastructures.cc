@@ -9,6 +9,9 @@
 #include <random>
 
 #include <cmath>
+#include <numeric>
+#include <cstring>
+#include <ostream>
 
 std::minstd_rand rand_engine; // Reasonably quick pseudo-random generator
 
@@ -23,6 +26,45 @@ Type random_in_range(Type start, Type end)
     return static_cast<Type>(start+num);
 }
 
+// Compares a*b with c*d exactly for factors less than 2^32 in magnitude, whose
+// products may not fit in a long long. Returns -1, 0 or 1.
+static int compare_products(long long a, long long b, long long c, long long d)
+{
+    auto sign = [](long long x) { return (x > 0) - (x < 0); };
+    int sign1 = sign(a) * sign(b);
+    int sign2 = sign(c) * sign(d);
+    if (sign1 != sign2 || sign1 == 0)
+    {
+        return (sign1 > sign2) - (sign1 < sign2);
+    }
+
+    auto magnitude = [](long long x) { return static_cast<unsigned long long>(x < 0 ? -x : x); };
+    unsigned long long product1 = magnitude(a) * magnitude(b);
+    unsigned long long product2 = magnitude(c) * magnitude(d);
+    int order = (product1 > product2) - (product1 < product2);
+    return sign1 > 0 ? order : -order;
+}
+
+// Reserves room for 'more' elements, at least doubling the capacity so that
+// reserving for repeated batches stays amortized constant time per element
+template <typename Type>
+void reserve_more(std::vector<Type> &vector, std::size_t more)
+{
+    if (vector.size() + more > vector.capacity())
+    {
+        vector.reserve(std::max(vector.size() + more, 2 * vector.capacity()));
+    }
+}
+
+template <typename Key, typename Value>
+void reserve_more(std::unordered_map<Key, Value> &map, std::size_t more)
+{
+    if (map.size() + more > map.bucket_count() * map.max_load_factor())
+    {
+        map.reserve(std::max(map.size() + more, 2 * map.size()));
+    }
+}
+
 // Modify the code below to implement the functionality of the class.
 // Also remove comments from the parameter names when you implement
 // an operation (Commenting out parameter name prevents compiler from
@@ -50,7 +92,7 @@ Datastructures::~Datastructures()
  */
 unsigned int Datastructures::station_count()
 {
-    return stations_.size();
+    return stationCount_;
 }
 
 /**
@@ -58,8 +100,20 @@ unsigned int Datastructures::station_count()
  */
 void Datastructures::clear_all()
 {    
-    stations_.clear();
+    // Handles stay interned, only the station data is dropped
+    for (auto &station : stations_)
+    {
+        station = Station();
+    }
+
+    stationCount_ = 0;
+    grid_.clear();
+    byName_.clear();
+    byDistance_.clear();
+    ordersDirty_ = false;
     regions_.clear();
+    regionsDirty_ = true;
+    graphDirty_ = true;
 }
 
 /**
@@ -68,15 +122,17 @@ void Datastructures::clear_all()
  */
 std::vector<StationID> Datastructures::all_stations()
 {
-    std::vector<StationID> allStations;
-    allStations.reserve(stations_.size());
-
-    for (auto it = stations_.begin(); it != stations_.end(); ++it)
-    {
-        allStations.push_back(it->first);
-    }
+    auto view = all_stations_view();
+    return std::vector<StationID>(view.begin(), view.end());
+}
 
-    return allStations;
+/**
+ * @brief Datastructures::all_stations_view Lists every existing station without copying the IDs
+ * @return A view of the stations, valid until the next change
+ */
+Datastructures::View<Datastructures::StationIterator> Datastructures::all_stations_view()
+{
+    return View<StationIterator>(StationIterator(this, 0), StationIterator(this, stations_.size()), stationCount_);
 }
 
 /**
@@ -88,17 +144,74 @@ std::vector<StationID> Datastructures::all_stations()
  */
 bool Datastructures::add_station(StationID id, const Name& name, Coord xy)
 {
-    if (stations_.find(id) != stations_.end())
+    if (findStation(id) != nullptr)
     {
         return false;
     }
 
-    Station newStation;
+    StationHandle handle = internStation(id);
+
+    Station &newStation = stations_[handle];
+    newStation.exists = true;
     newStation.name = name;
     newStation.location = xy;
     newStation.region = NO_REGION;
 
-    stations_.insert(std::make_pair(id, newStation));
+    grid_.insert(handle, xy);
+    orderStation(handle);
+    stationCount_++;
+    graphDirty_ = true;
+
+    return true;
+}
+
+/**
+ * @brief Datastructures::add_stations Creates several new stations at once
+ * @param stations ID, name and coordinates of each station
+ * @return Were the stations added? Nothing is added if a station already exists or is given twice
+ */
+bool Datastructures::add_stations(std::vector<std::tuple<StationID, Name, Coord>> const& stations)
+{
+    // Check every station first so that nothing is added on failure
+    std::unordered_set<std::string_view> ids;
+    ids.reserve(stations.size());
+    for (const auto &station : stations)
+    {
+        const StationID &id = std::get<0>(station);
+        if (findStation(id) != nullptr || !ids.insert(id).second)
+        {
+            return false;
+        }
+    }
+
+    reserve(stations.size(), 0, 0);
+
+    // Sorting all the stations once is cheaper than inserting a large batch one at a time
+    bool rebuild = orderingMode_ == OrderingMode::INCREMENTAL && stations.size() >= stationCount_;
+
+    for (const auto &[id, name, xy] : stations)
+    {
+        StationHandle handle = internStation(id);
+
+        Station &newStation = stations_[handle];
+        newStation.exists = true;
+        newStation.name = name;
+        newStation.location = xy;
+        newStation.region = NO_REGION;
+
+        grid_.insert(handle, xy);
+        if (!rebuild)
+        {
+            orderStation(handle);
+        }
+    }
+
+    stationCount_ += stations.size();
+    if (rebuild)
+    {
+        rebuildOrders();
+    }
+    graphDirty_ = true;
 
     return true;
 }
@@ -110,11 +223,11 @@ bool Datastructures::add_station(StationID id, const Name& name, Coord xy)
  */
 Name Datastructures::get_station_name(StationID id)
 {
-    auto stationIt = stations_.find(id);
+    Station* station = findStation(id);
 
-    if (stationIt != stations_.end())
+    if (station != nullptr)
     {
-        return stationIt->second.name;
+        return station->name;
     }
 
     return NO_NAME;
@@ -127,11 +240,11 @@ Name Datastructures::get_station_name(StationID id)
  */
 Coord Datastructures::get_station_coordinates(StationID id)
 {
-    auto stationIt = stations_.find(id);
+    Station* station = findStation(id);
 
-    if (stationIt != stations_.end())
+    if (station != nullptr)
     {
-        return stationIt->second.location;
+        return station->location;
     }
 
     return NO_COORD;
@@ -143,52 +256,70 @@ Coord Datastructures::get_station_coordinates(StationID id)
  */
 std::vector<StationID> Datastructures::stations_alphabetically()
 {
-    std::vector<std::pair<StationID, Name>> stations;
     std::vector<StationID> idOnly;
+    idOnly.reserve(stationCount_);
 
-    stations.reserve(stations_.size());
-    idOnly.reserve(stations_.size());
-
-    for (auto it = stations_.begin(); it != stations_.end(); ++it)
+    if (orderingMode_ == OrderingMode::SORT || orderingMode_ == OrderingMode::RADIX)
     {
-        stations.push_back(std::make_pair(it->first, it->second.name));
+        auto names = nameKeys();
+        std::sort(names.begin(), names.end(), byName_.key_comp());
+
+        for (const auto &entry : names)
+        {
+            idOnly.push_back(stationIds_[entry.second]);
+        }
+        return idOnly;
     }
 
-    std::sort(stations.begin(), stations.end(),
-              [](auto a, auto b) {return a.second < b.second;});
+    if (ordersDirty_)
+    {
+        rebuildOrders();
+    }
 
-    for (const auto &pair : stations)
+    for (const auto &entry : byName_)
     {
-        idOnly.push_back(pair.first);
+        idOnly.push_back(stationIds_[entry.second]);
     }
 
     return idOnly;
 }
 
 /**
- * @brief Datastructures::stations_distance_increasing Sorts the existing stations by their coordinates
+ * @brief Datastructures::stations_distance_increasing Sorts the existing stations by their distance from the origin
  * @return Sorted vector containing the stations
  */
 std::vector<StationID> Datastructures::stations_distance_increasing()
 {
-
-    std::vector<std::pair<StationID, Coord>> stations;
     std::vector<StationID> idOnly;
+    idOnly.reserve(stationCount_);
 
-    stations.reserve(stations_.size());
-    idOnly.reserve(stations_.size());
-
-    for (auto it = stations_.begin(); it != stations_.end(); ++it)
+    if (orderingMode_ == OrderingMode::SORT || orderingMode_ == OrderingMode::RADIX)
     {
-        stations.push_back(std::make_pair(it->first, it->second.location));
+        auto distances = distanceKeys();
+        if (orderingMode_ == OrderingMode::RADIX)
+        {
+            radixSort(distances);
+        }
+        else
+        {
+            std::sort(distances.begin(), distances.end(), byDistance_.key_comp());
+        }
+
+        for (const auto &entry : distances)
+        {
+            idOnly.push_back(stationIds_[entry.second]);
+        }
+        return idOnly;
     }
 
-    std::sort(stations.begin(), stations.end(),
-              [this](auto a, auto b) {return euclideanDistance(a.second) < euclideanDistance(b.second);});
+    if (ordersDirty_)
+    {
+        rebuildOrders();
+    }
 
-    for (const auto &pair : stations)
+    for (const auto &entry : byDistance_)
     {
-        idOnly.push_back(pair.first);
+        idOnly.push_back(stationIds_[entry.second]);
     }
 
     return idOnly;
@@ -201,15 +332,11 @@ std::vector<StationID> Datastructures::stations_distance_increasing()
  */
 StationID Datastructures::find_station_with_coord(Coord xy)
 {
-    auto stationIt = std::find_if(stations_.begin(), stations_.end(),
-                                  [xy](std::pair<StationID, Station> pair)
-                                  {
-                                      return pair.second.location == xy;
-                                  });
+    StationHandle handle = grid_.find(xy);
 
-    if (stationIt != stations_.end())
+    if (handle != NO_HANDLE)
     {
-        return stationIt->first; // StationID
+        return stationIds_[handle]; // StationID
     }
 
     return NO_STATION;
@@ -223,14 +350,21 @@ StationID Datastructures::find_station_with_coord(Coord xy)
  */
 bool Datastructures::change_station_coord(StationID id, Coord newcoord)
 {
-    auto stationIt = stations_.find(id);
+    Station* station = findStation(id);
 
-    if (stationIt == stations_.end())
+    if (station == nullptr)
     {
         return false;
     }
 
-    stationIt->second.location = newcoord;
+    StationHandle handle = findStationHandle(id);
+    grid_.erase(handle, station->location);
+    grid_.insert(handle, newcoord);
+    unorderStation(handle);
+
+    station->location = newcoord;
+    orderStation(handle);
+    graphDirty_ = true;
     return true;
 }
 
@@ -250,12 +384,65 @@ bool Datastructures::add_departure(StationID stationid, TrainID trainid, Time ti
         return false;
     }
 
-    // Add a departure time if it doesn't exist
-    std::set<TrainID> departingTrains;
-    station->departures.insert(std::make_pair(time, departingTrains));
+    return insertDeparture(*station, std::make_pair(time, internTrain(trainid)));
+}
+
+/**
+ * @brief Datastructures::add_departures Adds several departures at once
+ * @param departures Station ID, train ID and time of each departure
+ * @return Were the departures added? Nothing is added if a station doesn't exist or a departure exists or is given twice
+ */
+bool Datastructures::add_departures(std::vector<std::tuple<StationID, TrainID, Time>> const& departures)
+{
+    // Check every departure first so that nothing is added on failure
+    std::vector<std::pair<StationHandle, Departure>> added;
+    added.reserve(departures.size());
+    unsigned int newTrains = 0; // Upper bound, a new train may be given several times
+    for (const auto &[stationid, trainid, time] : departures)
+    {
+        StationHandle station = findStationHandle(stationid);
+        if (station == NO_HANDLE || !stations_[station].exists)
+        {
+            return false;
+        }
+
+        // A train without a handle can't have departures yet
+        TrainHandle train = findTrainHandle(trainid);
+        const auto &stationDepartures = stations_[station].departures;
+        if (train != NO_HANDLE && std::binary_search(stationDepartures.begin(), stationDepartures.end(),
+                                                     std::make_pair(time, train), DepartureLess{&trainIds_}))
+        {
+            return false;
+        }
+
+        added.emplace_back(station, std::make_pair(time, train));
+        newTrains += (train == NO_HANDLE);
+    }
+
+    // New trains have no handles yet, so departures given twice are found by their IDs
+    auto key = [&added, &departures](std::size_t i)
+    {
+        return std::tie(added[i].first, added[i].second.first, std::get<1>(departures[i]));
+    };
+    std::vector<std::size_t> order(added.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&key](std::size_t a, std::size_t b){ return key(a) < key(b); });
+    if (std::adjacent_find(order.begin(), order.end(), [&key](std::size_t a, std::size_t b){ return key(a) == key(b); }) != order.end())
+    {
+        return false;
+    }
+
+    // The batch is valid, only now are the new trains interned
+    reserve(0, 0, newTrains);
+    for (std::size_t i = 0; i < added.size(); ++i)
+    {
+        if (added[i].second.second == NO_HANDLE)
+        {
+            added[i].second.second = internTrain(std::get<1>(departures[i]));
+        }
+    }
 
-    // .second = bool: insert happened
-    return station->departures.at(time).insert(trainid).second;
+    return mergeDepartures(added, false);
 }
 
 /**
@@ -268,27 +455,42 @@ bool Datastructures::add_departure(StationID stationid, TrainID trainid, Time ti
 bool Datastructures::remove_departure(StationID stationid, TrainID trainid, Time time)
 {
     Station* station = findStation(stationid);
+    TrainHandle train = findTrainHandle(trainid);
 
     if (station == nullptr)
     {
         return false; // Station not found
     }
 
-    auto departureIt = station->departures.find(time);
+    if (train == NO_HANDLE)
+    {
+        return false; // Train not found
+    }
+
+    Departure departure(time, train);
+    auto &departures = station->departures;
+    auto departureIt = std::lower_bound(departures.begin(), departures.end(), departure, DepartureLess{&trainIds_});
 
-    if (departureIt == station->departures.end())
+    if (departureIt == departures.end() || *departureIt != departure)
     {
-        return false; // Departure time not found
+        return false; // Departure not found
     }
 
-    auto trainIt = station->departures.at(time).find(trainid);
+    departures.erase(departureIt);
 
-    if (trainIt == station->departures.at(time).end())
+    // The train no longer leaves the station at this stop, drop its leg to the next stop.
+    // The graph snapshot builds the RAPTOR trips from the legs, so they are cut here too
+    StationHandle handle = findStationHandle(stationid);
+    const auto &route = trains_[train].route;
+    for (std::size_t i = 0; i + 1 < route.size(); i++)
     {
-        return false; // Train not found
+        if (route[i].first == handle && route[i].second == time)
+        {
+            removeLeg(*station, route[i + 1].first, {train, time, route[i + 1].second});
+            graphDirty_ = true;
+        }
     }
 
-    station->departures.at(time).erase(trainid);
     return true; // Removal successful
 }
 
@@ -300,36 +502,47 @@ bool Datastructures::remove_departure(StationID stationid, TrainID trainid, Time
  */
 std::vector<std::pair<Time, TrainID>> Datastructures::station_departures_after(StationID stationid, Time time)
 {
-    Station* station = findStation(stationid);
+    auto view = station_departures_after_view(stationid, time);
     std::vector<std::pair<Time, TrainID>> departures;
 
-    if (station == nullptr)
+    if (!view)
     {
         departures.push_back(std::make_pair(NO_TIME, NO_TRAIN));
         return departures;
     }
 
-    // Find the position of the first eligible time
-    auto depIt = station->departures.begin();
-    while (depIt != station->departures.end())
+    departures.reserve(view->size());
+    for (auto [deptime, trainid] : *view)
     {
-        if (depIt->first >= time)
-        {
-            break;
-        }
-        depIt++;
+        departures.push_back(std::make_pair(deptime, trainid));
     }
 
-    // Return all departures later than 'time'
-    for (auto it = depIt; it != station->departures.end(); ++it)
+    return departures;
+}
+
+/**
+ * @brief Datastructures::station_departures_after_view Finds all departures at a given station during or after a given time, without copying them
+ * @param stationid Station ID
+ * @param time Departure time
+ * @return A view of the departures, valid until the next change. std::nullopt if the station doesn't exist.
+ */
+std::optional<Datastructures::View<Datastructures::DepartureIterator>> Datastructures::station_departures_after_view(StationID stationid, Time time)
+{
+    Station* station = findStation(stationid);
+
+    if (station == nullptr)
     {
-        for (const auto &train : it->second)
-        {
-            departures.push_back(std::make_pair(it->first, train));
-        }
+        return std::nullopt;
     }
 
-    return departures;
+    // Find the position of the first eligible time
+    const auto &departures = station->departures;
+    auto depIt = std::lower_bound(departures.begin(), departures.end(), time,
+                                  [](const Departure &departure, Time t) { return departure.first < t; });
+
+    const Departure* first = departures.data() + (depIt - departures.begin());
+    const Departure* last = departures.data() + departures.size();
+    return View<DepartureIterator>(DepartureIterator(&trainIds_, first), DepartureIterator(&trainIds_, last), last - first);
 }
 
 /**
@@ -354,6 +567,7 @@ bool Datastructures::add_region(RegionID id, const Name &name, std::vector<Coord
     newRegion.parentRegion = NO_REGION;
 
     regions_.insert(std::make_pair(id, newRegion));
+    regionsDirty_ = true;
     return true;
 }
 
@@ -398,17 +612,30 @@ Name Datastructures::get_region_name(RegionID id)
  */
 std::vector<Coord> Datastructures::get_region_coords(RegionID id)
 {
-    std::vector<Coord> vertices;
-    auto regionIt = regions_.find(id);
-    if (regionIt == regions_.end())
+    auto view = get_region_coords_view(id);
+    if (!view)
     {
-        vertices.push_back(NO_COORD);
-        return vertices;
+        return {NO_COORD};
     }
-    else
+
+    return std::vector<Coord>(view->begin(), view->end());
+}
+
+/**
+ * @brief Datastructures::get_region_coords_view Gets the vertex coordinates of a given region without copying them
+ * @param id Region ID
+ * @return A view of the vertices, valid until the next change. std::nullopt if the region doesn't exist.
+ */
+std::optional<Datastructures::View<const Coord*>> Datastructures::get_region_coords_view(RegionID id)
+{
+    auto regionIt = regions_.find(id);
+    if (regionIt == regions_.end())
     {
-        return regionIt->second.vertices;
+        return std::nullopt;
     }
+
+    const auto &vertices = regionIt->second.vertices;
+    return View<const Coord*>(vertices.data(), vertices.data() + vertices.size(), vertices.size());
 }
 
 /**
@@ -430,6 +657,7 @@ bool Datastructures::add_subregion_to_region(RegionID id, RegionID parentid)
 
     regionIt->second.parentRegion = parentid;
     parentRegionIt->second.subregions.push_back(id);
+    regionsDirty_ = true;
     return true;
 }
 
@@ -441,16 +669,16 @@ bool Datastructures::add_subregion_to_region(RegionID id, RegionID parentid)
  */
 bool Datastructures::add_station_to_region(StationID id, RegionID parentid)
 {
-    auto stationIt = stations_.find(id);
+    Station* station = findStation(id);
     auto parentRegionIt = regions_.find(parentid);
 
-    if (stationIt == stations_.end() || parentRegionIt == regions_.end()
-            || stationIt->second.region != NO_REGION)
+    if (station == nullptr || parentRegionIt == regions_.end()
+            || station->region != NO_REGION)
     {
         return false;
     }
 
-    stationIt->second.region = parentid;
+    station->region = parentid;
     return true;
 }
 
@@ -492,7 +720,16 @@ std::vector<RegionID> Datastructures::all_subregions_of_region(RegionID id)
         return subregions;
     }
 
-    getChildren(id, subregions); // Saves children directly in the 'subregions' vector
+    const RegionTree &tree = regionTree();
+    auto indexIt = tree.index.find(id);
+    if (indexIt == tree.index.end())
+    {
+        return subregions; // Part of a parent cycle
+    }
+
+    // Every subregion follows the region in preorder
+    unsigned int index = indexIt->second;
+    subregions.assign(tree.order.begin() + index + 1, tree.order.begin() + tree.end[index]);
     return subregions;
 }
 
@@ -502,78 +739,41 @@ std::vector<RegionID> Datastructures::all_subregions_of_region(RegionID id)
  * @return Vector containing the nearest stations
  */
 std::vector<StationID> Datastructures::stations_closest_to(Coord xy)
+{
+    return stations_closest_k(xy, 3);
+}
+
+/**
+ * @brief Datastructures::stations_closest_k Finds the k stations closest to the given coordinates.
+ * @param xy Coordinates
+ * @param k Number of stations
+ * @return Vector containing at most k stations, closest first
+ */
+std::vector<StationID> Datastructures::stations_closest_k(Coord xy, unsigned int k)
 {
     std::vector<StationID> closeStations;
-    auto stationIt = stations_.begin();
-    closeStations.reserve(3);
 
-    // For small station counts, simpy sort them by the distance
-    if (stations_.size() <= 3)
+    for (StationHandle handle : grid_.nearest(xy, std::min(k, stationCount_)))
     {
-        std::vector<std::pair<StationID, Coord>> allStations;
-
-        for (const auto &station : stations_)
-        {
-            allStations.push_back(std::make_pair(station.first, station.second.location));
-        }
-
-        std::sort(allStations.begin(), allStations.end(),
-                  [this, xy](auto a, auto b)
-                  {
-                      return euclideanDistance2(a.second, xy) < euclideanDistance2(b.second, xy);
-                  });
-
-        for (const auto &station : allStations)
-        {
-            closeStations.push_back(station.first);
-        }
-        return closeStations;
+        closeStations.push_back(stationIds_[handle]);
     }
 
+    return closeStations;
+}
 
-    /* For larger amount of stations, iterate through the list and keep track of
-     * the top 3 closest stations */
-
-    double current;
-
-    // Pick initial values
-    closeStations.push_back(NO_STATION);
-    closeStations.push_back(NO_STATION);
-    closeStations.push_back(NO_STATION);
-
-    // Keep track of the distances to reduce the need for recalculation
-    double first, second, third;
-    first = second = third = __DBL_MAX__;
+/**
+ * @brief Datastructures::stations_within_radius Finds the stations at most the given distance away from the coordinates.
+ * @param xy Coordinates
+ * @param radius Maximum distance
+ * @return Vector containing the stations, closest first
+ */
+std::vector<StationID> Datastructures::stations_within_radius(Coord xy, Distance radius)
+{
+    std::vector<StationID> closeStations;
 
-    while (stationIt != stations_.end())
+    for (StationHandle handle : grid_.withinRadius(xy, radius))
     {
-        current = euclideanDistance2(stationIt->second.location, xy);
-
-        if (current <= third)
-        {
-            third = current;
-            closeStations.at(2) = stationIt->first;
-        }
-
-        if (current <= second)
-        {
-            third = second;
-            second = current;
-
-            closeStations.at(2) = closeStations.at(1);
-            closeStations.at(1) = stationIt->first;
-        }
-
-        if (current <= first)
-        {
-            second = first;
-            first = current;
-
-            closeStations.at(1) = closeStations.at(0);
-            closeStations.at(0) = stationIt->first;
-        }
-
-        stationIt++;
+        closeStations.push_back(stationIds_[handle]);
     }
 
     return closeStations;
@@ -586,14 +786,20 @@ std::vector<StationID> Datastructures::stations_closest_to(Coord xy)
  */
 bool Datastructures::remove_station(StationID id)
 {
-    auto stationIt = stations_.find(id);
+    Station* station = findStation(id);
 
-    if (stationIt == stations_.end())
+    if (station == nullptr)
     {
         return false;
     }
 
-    stations_.erase(stationIt);
+    StationHandle handle = findStationHandle(id);
+    grid_.erase(handle, station->location);
+    unorderStation(handle);
+
+    *station = Station(); // The handle stays reserved for the ID
+    stationCount_--;
+    graphDirty_ = true;
     return true;
 }
 
@@ -605,383 +811,2816 @@ bool Datastructures::remove_station(StationID id)
  */
 RegionID Datastructures::common_parent_of_regions(RegionID id1, RegionID id2)
 {
-    if (regions_.find(id1) == regions_.end() ||
-            regions_.find(id2) == regions_.end())
-    {
-        return NO_REGION;
-    }
-
-    std::vector<RegionID> region1Parents, region2Parents, commonParents;
-
-    // Get the parents of both regions
-    getParents(id1, region1Parents);
-    getParents(id2, region2Parents);
-
-    qDebug() << region1Parents << region2Parents;
-
-    // Find the first common element
-    auto firstCommonIt = std::find_first_of(region1Parents.begin(),
-                                            region1Parents.end(),
-                                            region2Parents.begin(),
-                                            region2Parents.end());
-
-    if (firstCommonIt == region1Parents.end())
-    {
-        // No common element found
-        return NO_REGION;
-    }
-
-    return *firstCommonIt;
+    return commonParent(regionTree(), id1, id2);
 }
 
 /**
- * @brief Datastructures::euclideanDistance Calculates the "normalized" euclidean distance of a single coordinate point.
- * @param xy Coordinates
- * @return Distance
+ * @brief Datastructures::common_parents_of_regions Finds the nearest common parent region of each pair of regions
+ * @param pairs Pairs of region IDs
+ * @return ID of the parent region for each pair, NO_REGION where common_parent_of_regions() would return it
  */
-double Datastructures::euclideanDistance(Coord xy)
+std::vector<RegionID> Datastructures::common_parents_of_regions(const std::vector<std::pair<RegionID, RegionID>> &pairs)
 {
-    return std::sqrt(xy.x*xy.x + xy.y*xy.y);
-}
+    const RegionTree &tree = regionTree();
+    std::vector<RegionID> parents;
+    parents.reserve(pairs.size());
 
-/**
- * @brief Datastructures::euclideanDistance2 Calculates the euclidean distance between 2 coordinates
- * @param xy1 Coordinate 1
- * @param xy2 Coordinate 2
- * @return Distance between the coordinates
- */
-double Datastructures::euclideanDistance2(Coord xy1, Coord xy2)
-{
-    return std::sqrt((xy1.x-xy2.x)*(xy1.x-xy2.x) + (xy1.y-xy2.y)*(xy1.y-xy2.y));
+    for (const auto &pair : pairs)
+    {
+        parents.push_back(commonParent(tree, pair.first, pair.second));
+    }
+
+    return parents;
 }
 
 /**
- * @brief Datastructures::findStation Finds the station with the given station ID.
- * @param id Station ID.
- * @return Pointer to the station, nullptr if the station is not found.
+ * @brief Datastructures::assign_stations_to_regions Adds every station without a region to the innermost region containing it
+ * @return Number of stations added to a region
  */
-Datastructures::Station* Datastructures::findStation(StationID id)
+unsigned int Datastructures::assign_stations_to_regions()
 {
-    auto stationIt = stations_.find(id);
+    const RegionTree &tree = regionTree();
+    std::vector<unsigned int> found;
+    unsigned int assigned = 0;
 
-    if (stationIt == stations_.end())
+    for (auto &station : stations_)
     {
-        return nullptr;
+        if (!station.exists || station.region != NO_REGION)
+        {
+            continue;
+        }
+
+        found.clear();
+        regionsAt(tree, station.location, found);
+
+        if (found.empty())
+        {
+            continue;
+        }
+
+        // Deepest region, the first one in preorder if several are equally deep
+        unsigned int innermost = *std::min_element(found.begin(), found.end(),
+                                                   [&tree](unsigned int a, unsigned int b)
+                                                   {
+                                                       return tree.depth[a] != tree.depth[b] ? tree.depth[a] > tree.depth[b] : a < b;
+                                                   });
+        station.region = tree.order[innermost];
+        assigned++;
     }
 
-    return &stationIt->second;
+    return assigned;
 }
 
 /**
- * @brief Datastructures::getParents Finds every parent of 'child' and adds them to the 'parents' vector
- * @param child Child region
- * @param parents Vector containing every parent region of 'child'
+ * @brief Datastructures::regions_at Finds the regions containing the given coordinates
+ * @param xy Coordinates
+ * @return Regions whose polygon contains xy, the deepest first and equally deep ones in preorder
  */
-void Datastructures::getParents(RegionID child, std::vector<RegionID> &parents)
+std::vector<RegionID> Datastructures::regions_at(Coord xy)
 {
-    auto childIt = regions_.find(child);
-    if (childIt == regions_.end() || childIt->second.parentRegion == NO_REGION)
+    const RegionTree &tree = regionTree();
+    std::vector<unsigned int> found;
+    regionsAt(tree, xy, found);
+
+    std::sort(found.begin(), found.end(), [&tree](unsigned int a, unsigned int b)
     {
-        return;
-    }
+        return tree.depth[a] != tree.depth[b] ? tree.depth[a] > tree.depth[b] : a < b;
+    });
 
-    RegionID parent = childIt->second.parentRegion;
+    std::vector<RegionID> regionids;
+    regionids.reserve(found.size());
+    for (auto index : found)
+    {
+        regionids.push_back(tree.order[index]);
+    }
 
-    parents.push_back(parent);
-    getParents(parent, parents);
+    return regionids;
 }
 
 /**
- * @brief Datastructures::getChildren Finds every subregion belonging to 'parent'
- * @param parent The parent region
- * @param children Vector containing every subregion
+ * @brief Datastructures::set_ordering_mode Selects how the station orderings are kept up to date
+ * @param mode INCREMENTAL, REBUILD, SORT or RADIX
  */
-void Datastructures::getChildren(RegionID parent, std::vector<RegionID> &children)
+void Datastructures::set_ordering_mode(OrderingMode mode)
 {
-    auto parentIt = regions_.find(parent);
-    if (parentIt == regions_.end() || parentIt->second.subregions.empty())
-    {
-        return;
-    }
+    orderingMode_ = mode;
 
-    for (const auto &childRegion : parentIt->second.subregions)
+    if (mode == OrderingMode::INCREMENTAL && ordersDirty_)
     {
-        children.push_back(childRegion);
-        getChildren(childRegion, children);
+        rebuildOrders();
     }
 }
 
-
 /**
- * @brief Datastructures::add_train Creates a new train
- * @param trainid ID of the new train
- * @param stationtimes The stations and departure times of the train
- * @return Was the train creation successful?
+ * @brief Datastructures::reserve Reserves room for stations, regions and trains about to be added
+ * @param stations Number of stations to be added
+ * @param regions Number of regions to be added
+ * @param trains Number of trains to be added
  */
-bool Datastructures::add_train(TrainID trainid, std::vector<std::pair<StationID, Time> > stationtimes)
+void Datastructures::reserve(unsigned int stations, unsigned int regions, unsigned int trains)
 {
-    if (trains_.find(trainid) != trains_.end())
-    {
-        return false;
-    }
-
-    Train newTrain;
+    reserve_more(stationIds_, stations);
+    reserve_more(stations_, stations);
+    reserve_more(stationHandles_, stations);
+    reserve_more(regions_, regions);
+    reserve_more(trainIds_, trains);
+    reserve_more(trains_, trains);
+    reserve_more(trainHandles_, trains);
+}
 
-    // insert in the end, not the beginning
-    for (const auto &stop : stationtimes)
-    {
-        newTrain.route.push_back(stop);
-    }
+// Binary snapshot of the stations, regions and trains. A fixed header is
+// followed by sections of fixed-width records, each starting at the 8-byte
+// aligned offset given in the header. Variable-length data (routes, departures,
+// vertices...) lives in its own section and is referred to by a Span of record
+// indices, strings are stored once in the string table and referred to by a
+// Span of bytes. Integers are in the byte order of the writing machine, which
+// the header records, so the records can be read in place from a mapped file.
+namespace
+{
 
-    auto stationIt = stations_.begin();
-    std::map<Time, std::set<TrainID>>* departures;
-    const Time* currentDepartureTime;
+char const SNAPSHOT_MAGIC[8] = {'P', 'R', 'G', '2', 'S', 'N', 'A', 'P'};
+std::uint32_t const SNAPSHOT_VERSION = 1;
+std::uint32_t const SNAPSHOT_BYTE_ORDER = 0x01020304;
 
-    // Add departure to all stations on the route
-    for (const auto &station : newTrain.route)
-    {
-        stationIt = stations_.find(station.first);
-        if (stationIt == stations_.end())
-        {
-            return false;
-        }
+enum SnapshotSection { STRINGS, STATIONS, DEPARTURES, SUCCESSORS, LEGS, TRAINS, STOPS, REGIONS, VERTICES, SUBREGIONS, SECTION_COUNT };
 
-        currentDepartureTime = &station.second;
-        departures = &stationIt->second.departures;
+struct SnapshotHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint64_t offsets[SECTION_COUNT];
+    std::uint64_t counts[SECTION_COUNT]; // Number of records, bytes in the string table
+};
+
+struct Span
+{
+    std::uint32_t first;
+    std::uint32_t count;
+};
 
-        if (departures->find(*currentDepartureTime) == departures->end())
-        {
-            std::set<TrainID> newDepartures;
-            departures->insert(std::make_pair(*currentDepartureTime, newDepartures));
-        }
+// The records have no implicit padding, so no uninitialized bytes get written
 
-        departures->at(*currentDepartureTime).insert(trainid);
+struct StationRecord
+{
+    Span id;
+    Span name;
+    std::int32_t x;
+    std::int32_t y;
+    std::uint64_t region;
+    Span departures;
+    Span successors;
+    std::uint32_t exists;
+    std::uint32_t padding;
+};
+
+struct DepartureRecord
+{
+    std::uint32_t train;
+    std::uint16_t time;
+    std::uint16_t padding;
+};
+
+struct SuccessorRecord
+{
+    std::uint32_t station;
+    Span legs;
+};
+
+struct LegRecord
+{
+    std::uint32_t train;
+    std::uint16_t departure;
+    std::uint16_t arrival;
+};
+
+struct TrainRecord
+{
+    Span id;
+    Span stops;
+    std::uint32_t exists;
+};
+
+struct StopRecord
+{
+    std::uint32_t station;
+    std::uint16_t time;
+    std::uint16_t padding;
+};
+
+struct RegionRecord
+{
+    std::uint64_t id;
+    std::uint64_t parent;
+    Span name;
+    Span vertices;
+    Span subregions;
+    std::uint32_t padding;
+    std::uint32_t padding2;
+};
+
+struct VertexRecord
+{
+    std::int32_t x;
+    std::int32_t y;
+};
+
+using SubregionRecord = std::uint64_t;
+
+static_assert(sizeof(StationRecord) == 56 && sizeof(DepartureRecord) == 8 && sizeof(SuccessorRecord) == 12 &&
+              sizeof(LegRecord) == 8 && sizeof(TrainRecord) == 20 && sizeof(StopRecord) == 8 &&
+              sizeof(RegionRecord) == 48 && sizeof(VertexRecord) == 8, "Snapshot records must not be padded");
+
+std::size_t const RECORD_SIZES[SECTION_COUNT] = {
+    1, sizeof(StationRecord), sizeof(DepartureRecord), sizeof(SuccessorRecord), sizeof(LegRecord),
+    sizeof(TrainRecord), sizeof(StopRecord), sizeof(RegionRecord), sizeof(VertexRecord), sizeof(SubregionRecord)
+};
+
+// Builds the sections of a snapshot in memory
+class SnapshotWriter
+{
+public:
+    template <typename Record>
+    Span add(SnapshotSection section, Record const &record)
+    {
+        std::uint32_t index = counts_[section]++;
+        sections_[section].append(reinterpret_cast<char const*>(&record), sizeof(Record));
+        return {index, 1};
+    }
+
+    // Span of the records added to the section since 'first'
+    Span since(SnapshotSection section, std::uint32_t first) const { return {first, counts_[section] - first}; }
+    std::uint32_t count(SnapshotSection section) const { return counts_[section]; }
+
+    Span string(std::string const &text)
+    {
+        auto found = strings_.find(text);
+        if (found != strings_.end())
+        {
+            return found->second;
+        }
+
+        Span span{static_cast<std::uint32_t>(sections_[STRINGS].size()), static_cast<std::uint32_t>(text.size())};
+        sections_[STRINGS] += text;
+        counts_[STRINGS] = sections_[STRINGS].size();
+        strings_.emplace(text, span);
+        return span;
+    }
+
+    bool write(std::ostream &output) const
+    {
+        SnapshotHeader header{};
+        std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.byteOrder = SNAPSHOT_BYTE_ORDER;
+
+        std::uint64_t offset = sizeof(SnapshotHeader);
+        for (unsigned int i = 0; i < SECTION_COUNT; ++i)
+        {
+            header.offsets[i] = offset;
+            header.counts[i] = counts_[i];
+            offset += padded(sections_[i].size());
+        }
+
+        char const zeros[8] = {};
+        output.write(reinterpret_cast<char const*>(&header), sizeof(header));
+        for (auto const &section : sections_)
+        {
+            output.write(section.data(), section.size());
+            output.write(zeros, padded(section.size()) - section.size());
+        }
+        return static_cast<bool>(output);
+    }
+
+private:
+    static std::uint64_t padded(std::uint64_t size) { return (size + 7) / 8 * 8; }
+
+    std::string sections_[SECTION_COUNT];
+    std::uint32_t counts_[SECTION_COUNT] = {};
+    std::unordered_map<std::string_view, Span> strings_; // Views into the strings being saved
+};
+
+// Reads the records of a snapshot in place
+class SnapshotReader
+{
+public:
+    explicit SnapshotReader(std::string_view data) : data_{data}
+    {
+        if (data.size() < sizeof(SnapshotHeader))
+        {
+            return;
+        }
+        std::memcpy(&header_, data.data(), sizeof(SnapshotHeader));
+        if (std::memcmp(header_.magic, SNAPSHOT_MAGIC, sizeof(header_.magic)) != 0 ||
+            header_.version != SNAPSHOT_VERSION || header_.byteOrder != SNAPSHOT_BYTE_ORDER)
+        {
+            return;
+        }
+
+        for (unsigned int i = 0; i < SECTION_COUNT; ++i)
+        {
+            if (header_.offsets[i] % 8 != 0 || header_.offsets[i] > data.size() ||
+                header_.counts[i] > (data.size() - header_.offsets[i]) / RECORD_SIZES[i] ||
+                header_.counts[i] >= std::numeric_limits<std::uint32_t>::max())
+            {
+                return;
+            }
+        }
+        valid_ = true;
+    }
+
+    bool valid() const { return valid_; }
+    std::uint32_t count(SnapshotSection section) const { return static_cast<std::uint32_t>(header_.counts[section]); }
+
+    // Is the span inside the section?
+    bool contains(SnapshotSection section, Span span) const
+    {
+        return span.first <= count(section) && span.count <= count(section) - span.first;
+    }
+
+    template <typename Record>
+    Record get(SnapshotSection section, std::uint32_t index) const
+    {
+        Record record;
+        std::memcpy(&record, data_.data() + header_.offsets[section] + std::uint64_t(index) * sizeof(Record), sizeof(Record));
+        return record;
+    }
+
+    std::string_view string(Span span) const
+    {
+        return data_.substr(header_.offsets[STRINGS] + span.first, span.count);
+    }
+
+private:
+    std::string_view data_;
+    SnapshotHeader header_{};
+    bool valid_ = false;
+};
+
+}
+
+/**
+ * @brief Datastructures::save_snapshot Writes the stations, regions and trains to a binary snapshot
+ * @param output Stream the snapshot is written to, opened in binary mode
+ * @return Was the snapshot written successfully?
+ */
+bool Datastructures::save_snapshot(std::ostream &output)
+{
+    SnapshotWriter writer;
+
+    // Every handle is saved, removed stations included, so that the handles stay the same
+    for (StationHandle handle = 0; handle < stations_.size(); ++handle)
+    {
+        const Station &station = stations_[handle];
+
+        std::uint32_t firstDeparture = writer.count(DEPARTURES);
+        for (const auto &departure : station.departures)
+        {
+            writer.add(DEPARTURES, DepartureRecord{departure.second, departure.first, 0});
+        }
+
+        // The legs of a successor are added before the successors themselves
+        std::vector<SuccessorRecord> successors;
+        for (const auto &successor : station.successors)
+        {
+            std::uint32_t firstLeg = writer.count(LEGS);
+            for (const auto &leg : successor.legs)
+            {
+                writer.add(LEGS, LegRecord{leg.train, leg.departure, leg.arrival});
+            }
+            successors.push_back({successor.station, writer.since(LEGS, firstLeg)});
+        }
+        std::uint32_t firstSuccessor = writer.count(SUCCESSORS);
+        for (const auto &successor : successors)
+        {
+            writer.add(SUCCESSORS, successor);
+        }
+
+        StationRecord record{};
+        record.id = writer.string(stationIds_[handle]);
+        record.name = writer.string(station.name);
+        record.x = station.location.x;
+        record.y = station.location.y;
+        record.region = station.region;
+        record.departures = writer.since(DEPARTURES, firstDeparture);
+        record.successors = writer.since(SUCCESSORS, firstSuccessor);
+        record.exists = station.exists;
+        writer.add(STATIONS, record);
+    }
+
+    for (TrainHandle handle = 0; handle < trains_.size(); ++handle)
+    {
+        std::uint32_t firstStop = writer.count(STOPS);
+        for (const auto &stop : trains_[handle].route)
+        {
+            writer.add(STOPS, StopRecord{stop.first, stop.second, 0});
+        }
+        writer.add(TRAINS, TrainRecord{writer.string(trainIds_[handle]), writer.since(STOPS, firstStop), trains_[handle].exists});
+    }
+
+    for (const auto &region : regions_)
+    {
+        std::uint32_t firstVertex = writer.count(VERTICES);
+        for (const auto &vertex : region.second.vertices)
+        {
+            writer.add(VERTICES, VertexRecord{vertex.x, vertex.y});
+        }
+        std::uint32_t firstSubregion = writer.count(SUBREGIONS);
+        for (RegionID subregion : region.second.subregions)
+        {
+            writer.add(SUBREGIONS, SubregionRecord{subregion});
+        }
+
+        RegionRecord record{};
+        record.id = region.first;
+        record.parent = region.second.parentRegion;
+        record.name = writer.string(region.second.name);
+        record.vertices = writer.since(VERTICES, firstVertex);
+        record.subregions = writer.since(SUBREGIONS, firstSubregion);
+        writer.add(REGIONS, record);
+    }
+
+    return writer.write(output);
+}
+
+/**
+ * @brief Datastructures::load_snapshot Replaces the data with a snapshot written by save_snapshot()
+ * @param data Contents of the snapshot
+ * @return False if the snapshot is not valid, in which case the data is left unchanged
+ */
+bool Datastructures::load_snapshot(std::string_view data)
+{
+    SnapshotReader reader(data);
+    if (!reader.valid())
+    {
+        return false;
+    }
+
+    std::uint32_t stationCount = reader.count(STATIONS);
+    std::uint32_t trainCount = reader.count(TRAINS);
+
+    // Trains first, the departures are checked against the train IDs
+    std::vector<TrainID> trainIds;
+    std::unordered_map<TrainID, TrainHandle> trainHandles;
+    std::vector<Train> trains(trainCount);
+    trainIds.reserve(trainCount);
+    trainHandles.reserve(trainCount);
+    for (TrainHandle handle = 0; handle < trainCount; ++handle)
+    {
+        auto record = reader.get<TrainRecord>(TRAINS, handle);
+        if (!reader.contains(STRINGS, record.id) || !reader.contains(STOPS, record.stops))
+        {
+            return false;
+        }
+
+        trainIds.emplace_back(reader.string(record.id));
+        if (!trainHandles.emplace(trainIds.back(), handle).second)
+        {
+            return false;
+        }
+
+        Train &train = trains[handle];
+        train.exists = record.exists != 0;
+        train.route.reserve(record.stops.count);
+        for (std::uint32_t i = 0; i < record.stops.count; ++i)
+        {
+            auto stop = reader.get<StopRecord>(STOPS, record.stops.first + i);
+            if (stop.station >= stationCount)
+            {
+                return false;
+            }
+            train.route.emplace_back(stop.station, stop.time);
+        }
+    }
+
+    std::vector<StationID> stationIds;
+    std::unordered_map<StationID, StationHandle> stationHandles;
+    std::vector<Station> stations(stationCount);
+    stationIds.reserve(stationCount);
+    stationHandles.reserve(stationCount);
+    for (StationHandle handle = 0; handle < stationCount; ++handle)
+    {
+        auto record = reader.get<StationRecord>(STATIONS, handle);
+        if (!reader.contains(STRINGS, record.id) || !reader.contains(STRINGS, record.name) ||
+            !reader.contains(DEPARTURES, record.departures) || !reader.contains(SUCCESSORS, record.successors))
+        {
+            return false;
+        }
+
+        stationIds.emplace_back(reader.string(record.id));
+        if (!stationHandles.emplace(stationIds.back(), handle).second)
+        {
+            return false;
+        }
+
+        Station &station = stations[handle];
+        station.exists = record.exists != 0;
+        station.name = reader.string(record.name);
+        station.location = {record.x, record.y};
+        station.region = record.region;
+
+        station.departures.reserve(record.departures.count);
+        for (std::uint32_t i = 0; i < record.departures.count; ++i)
+        {
+            auto departure = reader.get<DepartureRecord>(DEPARTURES, record.departures.first + i);
+            if (departure.train >= trainCount)
+            {
+                return false;
+            }
+            station.departures.emplace_back(departure.time, departure.train);
+        }
+        if (!std::is_sorted(station.departures.begin(), station.departures.end(), DepartureLess{&trainIds}))
+        {
+            return false;
+        }
+
+        station.successors.resize(record.successors.count);
+        for (std::uint32_t i = 0; i < record.successors.count; ++i)
+        {
+            auto successorRecord = reader.get<SuccessorRecord>(SUCCESSORS, record.successors.first + i);
+            if (successorRecord.station >= stationCount || !reader.contains(LEGS, successorRecord.legs))
+            {
+                return false;
+            }
+
+            Successor &successor = station.successors[i];
+            successor.station = successorRecord.station;
+            successor.legs.reserve(successorRecord.legs.count);
+            for (std::uint32_t j = 0; j < successorRecord.legs.count; ++j)
+            {
+                auto leg = reader.get<LegRecord>(LEGS, successorRecord.legs.first + j);
+                if (leg.train >= trainCount)
+                {
+                    return false;
+                }
+                successor.legs.push_back({leg.train, leg.departure, leg.arrival});
+            }
+        }
+    }
+
+    std::unordered_map<RegionID, Region> regions;
+    regions.reserve(reader.count(REGIONS));
+    for (std::uint32_t i = 0; i < reader.count(REGIONS); ++i)
+    {
+        auto record = reader.get<RegionRecord>(REGIONS, i);
+        if (record.id == NO_REGION || !reader.contains(STRINGS, record.name) ||
+            !reader.contains(VERTICES, record.vertices) || !reader.contains(SUBREGIONS, record.subregions))
+        {
+            return false;
+        }
+
+        auto inserted = regions.emplace(record.id, Region());
+        if (!inserted.second)
+        {
+            return false;
+        }
+
+        Region &region = inserted.first->second;
+        region.name = reader.string(record.name);
+        region.parentRegion = record.parent;
+        region.vertices.reserve(record.vertices.count);
+        for (std::uint32_t j = 0; j < record.vertices.count; ++j)
+        {
+            auto vertex = reader.get<VertexRecord>(VERTICES, record.vertices.first + j);
+            region.vertices.push_back({vertex.x, vertex.y});
+        }
+        region.subregions.reserve(record.subregions.count);
+        for (std::uint32_t j = 0; j < record.subregions.count; ++j)
+        {
+            region.subregions.push_back(reader.get<SubregionRecord>(SUBREGIONS, record.subregions.first + j));
+        }
+    }
+
+    // Every subregion must point back to the region listing it, and every region
+    // with a parent must be listed exactly once. This is what add_subregion_to_region()
+    // keeps, it doesn't rule out cycles so neither is it checked here.
+    std::unordered_set<RegionID> listed;
+    std::size_t childCount = 0;
+    for (const auto &region : regions)
+    {
+        if (region.second.parentRegion != NO_REGION)
+        {
+            childCount++;
+        }
+
+        for (RegionID child : region.second.subregions)
+        {
+            auto found = regions.find(child);
+            if (found == regions.end() || found->second.parentRegion != region.first || !listed.insert(child).second)
+            {
+                return false;
+            }
+        }
+    }
+    if (listed.size() != childCount)
+    {
+        return false;
+    }
+
+    for (const auto &station : stations)
+    {
+        if (station.exists && station.region != NO_REGION && regions.find(station.region) == regions.end())
+        {
+            return false;
+        }
+    }
+
+    // The snapshot is valid, replace the data
+    byName_.clear();
+    byDistance_.clear();
+    grid_.clear();
+
+    stationIds_ = std::move(stationIds);
+    stationHandles_ = std::move(stationHandles);
+    stations_ = std::move(stations);
+    trainIds_ = std::move(trainIds);
+    trainHandles_ = std::move(trainHandles);
+    trains_ = std::move(trains);
+    regions_ = std::move(regions);
+
+    stationCount_ = 0;
+    for (StationHandle handle = 0; handle < stations_.size(); ++handle)
+    {
+        if (stations_[handle].exists)
+        {
+            grid_.insert(handle, stations_[handle].location);
+            stationCount_++;
+        }
+    }
+
+    if (orderingMode_ == OrderingMode::INCREMENTAL)
+    {
+        rebuildOrders();
+    }
+    else
+    {
+        ordersDirty_ = true;
+    }
+
+    regionsDirty_ = true;
+    graphDirty_ = true;
+
+    return true;
+}
+
+/**
+ * @brief Datastructures::squaredDistance Calculates the squared distance of coordinates from the origin
+ * @param xy Coordinates
+ * @return Squared distance, computed in 64 bits
+ */
+std::int64_t Datastructures::squaredDistance(Coord xy)
+{
+    return static_cast<std::int64_t>(xy.x) * xy.x + static_cast<std::int64_t>(xy.y) * xy.y;
+}
+
+/**
+ * @brief Datastructures::orderStation Adds an existing station to the name and distance orderings
+ * @param handle Station handle
+ */
+void Datastructures::orderStation(StationHandle handle)
+{
+    if (orderingMode_ != OrderingMode::INCREMENTAL)
+    {
+        ordersDirty_ = true;
+        return;
+    }
+
+    const Station &station = stations_[handle];
+    byName_.insert(std::make_pair(station.name, handle));
+    byDistance_.insert(std::make_pair(squaredDistance(station.location), handle));
+}
+
+/**
+ * @brief Datastructures::unorderStation Removes a station from the name and distance orderings. Must be called before its data changes.
+ * @param handle Station handle
+ */
+void Datastructures::unorderStation(StationHandle handle)
+{
+    if (orderingMode_ != OrderingMode::INCREMENTAL)
+    {
+        ordersDirty_ = true;
+        return;
+    }
+
+    const Station &station = stations_[handle];
+    byName_.erase(std::make_pair(station.name, handle));
+    byDistance_.erase(std::make_pair(squaredDistance(station.location), handle));
+}
+
+/**
+ * @brief Datastructures::rebuildOrders Rebuilds the name and distance orderings from the existing stations
+ */
+void Datastructures::rebuildOrders()
+{
+    auto names = nameKeys();
+    auto distances = distanceKeys();
+
+    std::sort(names.begin(), names.end(), byName_.key_comp());
+    std::sort(distances.begin(), distances.end(), byDistance_.key_comp());
+
+    // Inserting sorted entries at the end takes amortized constant time each
+    byName_.clear();
+    for (auto &entry : names)
+    {
+        byName_.insert(byName_.end(), std::move(entry));
+    }
+
+    byDistance_.clear();
+    for (const auto &entry : distances)
+    {
+        byDistance_.insert(byDistance_.end(), entry);
+    }
+
+    ordersDirty_ = false;
+}
+
+/**
+ * @brief Datastructures::nameKeys Pairs every existing station with its name
+ * @return Unsorted (name, station) pairs
+ */
+std::vector<std::pair<Name, Datastructures::StationHandle>> Datastructures::nameKeys()
+{
+    std::vector<std::pair<Name, StationHandle>> names;
+    names.reserve(stationCount_);
+
+    for (StationHandle handle = 0; handle < stations_.size(); ++handle)
+    {
+        if (stations_[handle].exists)
+        {
+            names.push_back(std::make_pair(stations_[handle].name, handle));
+        }
+    }
+
+    return names;
+}
+
+/**
+ * @brief Datastructures::distanceKeys Pairs every existing station with its squared distance from the origin
+ * @return Unsorted (squared distance, station) pairs
+ */
+std::vector<std::pair<std::int64_t, Datastructures::StationHandle>> Datastructures::distanceKeys()
+{
+    std::vector<std::pair<std::int64_t, StationHandle>> distances;
+    distances.reserve(stationCount_);
+
+    for (StationHandle handle = 0; handle < stations_.size(); ++handle)
+    {
+        if (stations_[handle].exists)
+        {
+            distances.push_back(std::make_pair(squaredDistance(stations_[handle].location), handle));
+        }
+    }
+
+    return distances;
+}
+
+/**
+ * @brief Datastructures::radixSort Sorts (squared distance, station) pairs with an LSD radix sort, one byte of the key per pass.
+ * Passes where every key has the same byte are skipped, so small coordinates need only a few passes.
+ * Runs of equal keys are finally sorted by station ID.
+ * @param keys Pairs to sort, keys must not be negative
+ */
+void Datastructures::radixSort(std::vector<std::pair<std::int64_t, StationHandle>> &keys)
+{
+    constexpr unsigned int RADIX_BITS = 8;
+    constexpr std::size_t BUCKETS = std::size_t(1) << RADIX_BITS;
+
+    std::vector<std::pair<std::int64_t, StationHandle>> buffer(keys.size());
+
+    for (unsigned int shift = 0; shift < 64; shift += RADIX_BITS)
+    {
+        std::size_t counts[BUCKETS] = {};
+        for (const auto &entry : keys)
+        {
+            counts[(static_cast<std::uint64_t>(entry.first) >> shift) & (BUCKETS - 1)]++;
+        }
+
+        if (keys.empty() || counts[(static_cast<std::uint64_t>(keys.front().first) >> shift) & (BUCKETS - 1)] == keys.size())
+        {
+            continue; // Every key has the same digit
+        }
+
+        std::size_t offset = 0;
+        for (auto &count : counts)
+        {
+            std::size_t bucketSize = count;
+            count = offset;
+            offset += bucketSize;
+        }
+
+        for (const auto &entry : keys)
+        {
+            buffer[counts[(static_cast<std::uint64_t>(entry.first) >> shift) & (BUCKETS - 1)]++] = entry;
+        }
+        keys.swap(buffer);
+    }
+
+    // Equal keys came out in handle order, put them in ID order
+    for (auto runBegin = keys.begin(); runBegin != keys.end(); )
+    {
+        auto runEnd = std::find_if(runBegin, keys.end(),
+                                   [runBegin](const auto &entry) { return entry.first != runBegin->first; });
+        if (runEnd - runBegin > 1)
+        {
+            std::sort(runBegin, runEnd, byDistance_.key_comp());
+        }
+        runBegin = runEnd;
+    }
+}
+
+/**
+ * @brief Datastructures::euclideanDistance2 Calculates the euclidean distance between 2 coordinates
+ * @param xy1 Coordinate 1
+ * @param xy2 Coordinate 2
+ * @return Distance between the coordinates
+ */
+double Datastructures::euclideanDistance2(Coord xy1, Coord xy2)
+{
+    return std::sqrt((xy1.x-xy2.x)*(xy1.x-xy2.x) + (xy1.y-xy2.y)*(xy1.y-xy2.y));
+}
+
+/**
+ * @brief Datastructures::internStation Gets the handle of a station ID, assigning a new one if the ID hasn't been seen before
+ * @param id Station ID
+ * @return Handle of the ID
+ */
+Datastructures::StationHandle Datastructures::internStation(const StationID &id)
+{
+    auto handleIt = stationHandles_.insert(std::make_pair(id, stationIds_.size())).first;
+
+    if (handleIt->second == stationIds_.size())
+    {
+        stationIds_.push_back(id);
+        stations_.emplace_back();
+    }
+
+    return handleIt->second;
+}
+
+/**
+ * @brief Datastructures::internTrain Gets the handle of a train ID, assigning a new one if the ID hasn't been seen before
+ * @param id Train ID
+ * @return Handle of the ID
+ */
+Datastructures::TrainHandle Datastructures::internTrain(const TrainID &id)
+{
+    auto handleIt = trainHandles_.insert(std::make_pair(id, trainIds_.size())).first;
+
+    if (handleIt->second == trainIds_.size())
+    {
+        trainIds_.push_back(id);
+        trains_.emplace_back();
+    }
+
+    return handleIt->second;
+}
+
+/**
+ * @brief Datastructures::findStationHandle Gets the handle of a station ID without interning it
+ * @param id Station ID
+ * @return Handle of the ID, NO_HANDLE if the ID hasn't been seen
+ */
+Datastructures::StationHandle Datastructures::findStationHandle(const StationID &id)
+{
+    auto handleIt = stationHandles_.find(id);
+
+    if (handleIt == stationHandles_.end())
+    {
+        return NO_HANDLE;
+    }
+
+    return handleIt->second;
+}
+
+/**
+ * @brief Datastructures::findTrainHandle Gets the handle of a train ID without interning it
+ * @param id Train ID
+ * @return Handle of the ID, NO_HANDLE if the ID hasn't been seen
+ */
+Datastructures::TrainHandle Datastructures::findTrainHandle(const TrainID &id)
+{
+    auto handleIt = trainHandles_.find(id);
+
+    if (handleIt == trainHandles_.end())
+    {
+        return NO_HANDLE;
+    }
+
+    return handleIt->second;
+}
+
+/**
+ * @brief Datastructures::findStation Finds the station with the given station ID.
+ * @param id Station ID.
+ * @return Pointer to the station, nullptr if the station is not found.
+ */
+Datastructures::Station* Datastructures::findStation(const StationID &id)
+{
+    StationHandle handle = findStationHandle(id);
+
+    if (handle == NO_HANDLE || !stations_[handle].exists)
+    {
+        return nullptr;
+    }
+
+    return &stations_[handle];
+}
+
+/**
+ * @brief Datastructures::insertDeparture Adds a departure to a station, keeping the departures sorted
+ * @param station Station
+ * @param departure Departure time and train
+ * @return False if the departure already existed
+ */
+bool Datastructures::insertDeparture(Station &station, const Departure &departure)
+{
+    auto &departures = station.departures;
+    auto departureIt = std::lower_bound(departures.begin(), departures.end(), departure, DepartureLess{&trainIds_});
+
+    if (departureIt != departures.end() && *departureIt == departure)
+    {
+        return false;
+    }
+
+    departures.insert(departureIt, departure);
+    return true;
+}
+
+/**
+ * @brief Datastructures::mergeDepartures Adds departures to several stations, merging them with the sorted departures of each station
+ * @param departures Station handle and departure of each departure to add, sorted in place
+ * @param allowDuplicates Are departures given twice or already existing skipped? If not, nothing is added if there are any given twice
+ * @return False if a departure is given twice and duplicates aren't allowed
+ */
+bool Datastructures::mergeDepartures(std::vector<std::pair<StationHandle, Departure>> &departures, bool allowDuplicates)
+{
+    DepartureLess departureLess{&trainIds_};
+    std::sort(departures.begin(), departures.end(),
+              [departureLess](const std::pair<StationHandle, Departure> &a, const std::pair<StationHandle, Departure> &b)
+              {
+                  if (a.first != b.first) { return a.first < b.first; }
+                  return departureLess(a.second, b.second);
+              });
+
+    if (!allowDuplicates && std::adjacent_find(departures.begin(), departures.end()) != departures.end())
+    {
+        return false;
+    }
+
+    for (auto first = departures.begin(); first != departures.end(); )
+    {
+        auto last = std::find_if(first, departures.end(), [first](const auto &departure){ return departure.first != first->first; });
+
+        auto &stationDepartures = stations_[first->first].departures;
+        std::size_t oldCount = stationDepartures.size();
+        for (auto departure = first; departure != last; ++departure)
+        {
+            stationDepartures.push_back(departure->second);
+        }
+        std::inplace_merge(stationDepartures.begin(), stationDepartures.begin() + oldCount, stationDepartures.end(), departureLess);
+        stationDepartures.erase(std::unique(stationDepartures.begin(), stationDepartures.end()), stationDepartures.end());
+
+        first = last;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Datastructures::addSuccessor Records a train leg from a station to its next stop
+ * @param from Departure station
+ * @param to Handle of the next stop
+ * @param leg Train and times of the leg
+ */
+void Datastructures::addSuccessor(Station &from, StationHandle to, const Leg &leg)
+{
+    auto successorIt = std::find_if(from.successors.begin(), from.successors.end(),
+                                    [to](const Successor &a){return a.station == to;});
+
+    if (successorIt == from.successors.end())
+    {
+        from.successors.push_back({to, {leg}});
+        return;
+    }
+
+    successorIt->legs.push_back(leg);
+}
+
+/**
+ * @brief Datastructures::removeLeg Removes a train leg from a station to its next stop, and the next stop if no legs are left
+ * @param from Departure station
+ * @param to Handle of the next stop
+ * @param leg Train and times of the leg
+ */
+void Datastructures::removeLeg(Station &from, StationHandle to, const Leg &leg)
+{
+    auto successorIt = std::find_if(from.successors.begin(), from.successors.end(),
+                                    [to](const Successor &a){return a.station == to;});
+
+    if (successorIt == from.successors.end())
+    {
+        return;
+    }
+
+    auto &legs = successorIt->legs;
+    auto legIt = std::find_if(legs.begin(), legs.end(), [&leg](const Leg &a)
+                              {return a.train == leg.train && a.departure == leg.departure && a.arrival == leg.arrival;});
+    if (legIt != legs.end())
+    {
+        legs.erase(legIt);
+    }
+
+    if (legs.empty())
+    {
+        from.successors.erase(successorIt);
+    }
+}
+
+/**
+ * @brief Datastructures::regionTree Gets the flattened region tree, rebuilding it if the regions have changed
+ * @return The region tree
+ */
+const Datastructures::RegionTree& Datastructures::regionTree()
+{
+    if (!regionsDirty_)
+    {
+        return regionTree_;
+    }
+
+    RegionTree &tree = regionTree_;
+    tree.index.clear();
+    tree.order.clear();
+    tree.end.clear();
+    tree.parent.clear();
+    tree.depth.clear();
+    tree.index.reserve(regions_.size());
+
+    // Region being visited: preorder index, region, next subregion to visit
+    std::vector<std::tuple<unsigned int, const Region*, std::size_t>> stack;
+
+    auto visit = [&tree, &stack](RegionID id, const Region &region, unsigned int parent)
+    {
+        unsigned int index = tree.order.size();
+        tree.index.insert(std::make_pair(id, index));
+        tree.order.push_back(id);
+        tree.end.push_back(index + 1);
+        tree.parent.push_back(parent);
+        tree.depth.push_back(parent == NO_HANDLE ? 0 : tree.depth[parent] + 1);
+        stack.push_back(std::make_tuple(index, &region, 0));
+    };
+
+    for (const auto &root : regions_)
+    {
+        if (root.second.parentRegion != NO_REGION)
+        {
+            continue;
+        }
+
+        visit(root.first, root.second, NO_HANDLE);
+
+        while (!stack.empty())
+        {
+            auto &[index, region, next] = stack.back();
+
+            if (next == region->subregions.size())
+            {
+                tree.end[index] = tree.order.size();
+                stack.pop_back();
+                continue;
+            }
+
+            RegionID child = region->subregions[next++];
+            visit(child, regions_.at(child), index);
+        }
+    }
+
+    // Binary lifting table, level k built from level k-1
+    unsigned int count = tree.order.size();
+    unsigned int maxDepth = count == 0 ? 0 : *std::max_element(tree.depth.begin(), tree.depth.end());
+
+    tree.levels = 1;
+    while ((1u << tree.levels) <= maxDepth)
+    {
+        tree.levels++;
+    }
+
+    tree.jumps.assign(std::size_t(tree.levels) * count, NO_HANDLE);
+    std::copy(tree.parent.begin(), tree.parent.end(), tree.jumps.begin());
+
+    for (unsigned int level = 1; level < tree.levels; ++level)
+    {
+        const unsigned int* lower = tree.jumps.data() + std::size_t(level - 1) * count;
+        unsigned int* upper = tree.jumps.data() + std::size_t(level) * count;
+
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            upper[i] = lower[i] == NO_HANDLE ? NO_HANDLE : lower[lower[i]];
+        }
+    }
+
+    buildRegionBoxes(tree);
+
+    regionsDirty_ = false;
+    return regionTree_;
+}
+
+/**
+ * @brief Datastructures::getParents Finds every parent of 'child' and adds them to the 'parents' vector, nearest first
+ * @param child The child region
+ * @param parents Vector containing the parents
+ */
+void Datastructures::getParents(RegionID child, std::vector<RegionID> &parents)
+{
+    const RegionTree &tree = regionTree();
+    auto indexIt = tree.index.find(child);
+    if (indexIt == tree.index.end())
+    {
+        return;
+    }
+
+    unsigned int index = indexIt->second;
+    parents.reserve(parents.size() + tree.depth[index]);
+
+    for (unsigned int parent = tree.parent[index]; parent != NO_HANDLE; parent = tree.parent[parent])
+    {
+        parents.push_back(tree.order[parent]);
+    }
+}
+
+/**
+ * @brief Datastructures::commonParent Finds the nearest region that is a parent of both regions, the regions themselves excluded
+ * @param tree Region tree
+ * @param id1 Region 1 ID
+ * @param id2 Region 2 ID
+ * @return ID of the parent region, NO_REGION if there is none or either region is not found
+ */
+RegionID Datastructures::commonParent(const RegionTree &tree, RegionID id1, RegionID id2)
+{
+    auto index1It = tree.index.find(id1);
+    auto index2It = tree.index.find(id2);
+
+    if (index1It == tree.index.end() || index2It == tree.index.end())
+    {
+        return NO_REGION;
+    }
+
+    // The common parent is the lowest common ancestor of the parents
+    unsigned int a = tree.parent[index1It->second];
+    unsigned int b = tree.parent[index2It->second];
+
+    if (a == NO_HANDLE || b == NO_HANDLE)
+    {
+        return NO_REGION;
+    }
+
+    if (tree.contains(a, b))
+    {
+        return tree.order[a];
+    }
+    if (tree.contains(b, a))
+    {
+        return tree.order[b];
+    }
+
+    // Climb from 'a' to the highest ancestor that doesn't contain 'b', its parent is the answer
+    unsigned int count = tree.order.size();
+    for (unsigned int level = tree.levels; level-- > 0; )
+    {
+        unsigned int jump = tree.jumps[std::size_t(level) * count + a];
+        if (jump != NO_HANDLE && !tree.contains(jump, b))
+        {
+            a = jump;
+        }
+    }
+
+    unsigned int parent = tree.parent[a];
+    return parent == NO_HANDLE ? NO_REGION : tree.order[parent];
+}
+
+/**
+ * @brief Datastructures::buildRegionBoxes Builds the R-tree over the region bounding boxes with Sort-Tile-Recursive packing
+ * @param tree Region tree with the preorder already built
+ */
+void Datastructures::buildRegionBoxes(RegionTree &tree)
+{
+    constexpr unsigned int NODE_SIZE = 8;
+
+    tree.boxes.clear();
+    tree.vertices.clear();
+
+    for (unsigned int index = 0; index < tree.order.size(); ++index)
+    {
+        const auto &vertices = regions_.at(tree.order[index]).vertices;
+        tree.vertices.push_back(&vertices);
+
+        RegionTree::Box box{{std::numeric_limits<int>::max(), std::numeric_limits<int>::max()},
+                            {std::numeric_limits<int>::min(), std::numeric_limits<int>::min()}, index, index + 1};
+        for (const auto &vertex : vertices)
+        {
+            box.min = {std::min(box.min.x, vertex.x), std::min(box.min.y, vertex.y)};
+            box.max = {std::max(box.max.x, vertex.x), std::max(box.max.y, vertex.y)};
+        }
+        tree.boxes.push_back(box);
+    }
+
+    auto centerX = [](const RegionTree::Box &box) { return static_cast<long long>(box.min.x) + box.max.x; };
+    auto centerY = [](const RegionTree::Box &box) { return static_cast<long long>(box.min.y) + box.max.y; };
+
+    // Pack each level into nodes: sort by x into vertical slices, each slice by y into runs of NODE_SIZE
+    std::size_t levelBegin = 0;
+    std::size_t levelEnd = tree.boxes.size();
+
+    while (levelEnd - levelBegin > 1)
+    {
+        auto first = tree.boxes.begin() + levelBegin;
+        auto last = tree.boxes.begin() + levelEnd;
+        std::size_t count = levelEnd - levelBegin;
+        std::size_t nodes = (count + NODE_SIZE - 1) / NODE_SIZE;
+        std::size_t sliceSize = NODE_SIZE * static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(nodes))));
+
+        std::sort(first, last, [&](const auto &a, const auto &b) { return centerX(a) < centerX(b); });
+        for (std::size_t slice = 0; slice < count; slice += sliceSize)
+        {
+            std::sort(first + slice, first + std::min(count, slice + sliceSize),
+                      [&](const auto &a, const auto &b) { return centerY(a) < centerY(b); });
+        }
+
+        for (std::size_t child = levelBegin; child < levelEnd; child += NODE_SIZE)
+        {
+            unsigned int childEnd = std::min(levelEnd, child + NODE_SIZE);
+            RegionTree::Box node{tree.boxes[child].min, tree.boxes[child].max, static_cast<unsigned int>(child), childEnd};
+            for (unsigned int i = child + 1; i < childEnd; ++i)
+            {
+                node.min = {std::min(node.min.x, tree.boxes[i].min.x), std::min(node.min.y, tree.boxes[i].min.y)};
+                node.max = {std::max(node.max.x, tree.boxes[i].max.x), std::max(node.max.y, tree.boxes[i].max.y)};
+            }
+            tree.boxes.push_back(node);
+        }
+
+        levelBegin = levelEnd;
+        levelEnd = tree.boxes.size();
+    }
+}
+
+/**
+ * @brief Datastructures::regionsAt Finds the regions whose polygon contains the given coordinates
+ * @param tree Region tree
+ * @param xy Coordinates
+ * @param found Preorder indices of the regions are appended here
+ */
+void Datastructures::regionsAt(const RegionTree &tree, Coord xy, std::vector<unsigned int> &found)
+{
+    if (tree.boxes.empty())
+    {
+        return;
+    }
+
+    auto &stack = scratch_.frontier;
+    stack.clear();
+    stack.push_back(tree.boxes.size() - 1);
+
+    while (!stack.empty())
+    {
+        unsigned int boxIndex = stack.back();
+        stack.pop_back();
+
+        const auto &box = tree.boxes[boxIndex];
+        if (xy.x < box.min.x || xy.x > box.max.x || xy.y < box.min.y || xy.y > box.max.y)
+        {
+            continue;
+        }
+
+        if (boxIndex < tree.order.size())
+        {
+            // Region box, test the polygon itself
+            if (polygonContains(*tree.vertices[box.first], xy))
+            {
+                found.push_back(box.first);
+            }
+            continue;
+        }
+
+        for (unsigned int child = box.first; child < box.last; ++child)
+        {
+            stack.push_back(child);
+        }
+    }
+}
+
+/**
+ * @brief Datastructures::polygonContains Tests whether a point is inside a polygon with the crossing number rule.
+ * Counts the polygon edges crossed by a ray from the point towards positive x. The
+ * comparison is done with exact integer cross-multiplication instead of division.
+ * @param vertices Polygon vertices, the last one connecting back to the first
+ * @param xy Coordinates
+ * @return Is the point inside?
+ */
+bool Datastructures::polygonContains(const std::vector<Coord> &vertices, Coord xy)
+{
+    bool inside = false;
+
+    for (std::size_t i = 0, j = vertices.size() - 1; i < vertices.size(); j = i++)
+    {
+        const Coord &a = vertices[i];
+        const Coord &b = vertices[j];
+
+        if ((a.y > xy.y) != (b.y > xy.y))
+        {
+            // Is the point left of the edge at height xy.y? The differences are taken in
+            // 64 bits, their products can exceed a long long and are compared exactly
+            int side = compare_products(static_cast<long long>(xy.x) - a.x, static_cast<long long>(b.y) - a.y,
+                                        static_cast<long long>(xy.y) - a.y, static_cast<long long>(b.x) - a.x);
+            if (b.y > a.y ? side < 0 : side > 0)
+            {
+                inside = !inside;
+            }
+        }
+    }
+
+    return inside;
+}
+
+/**
+ * @brief Datastructures::add_train Creates a new train
+ * @param trainid ID of the new train
+ * @param stationtimes The stations and departure times of the train
+ * @return Was the train creation successful?
+ */
+bool Datastructures::add_train(TrainID trainid, std::vector<std::pair<StationID, Time> > stationtimes)
+{
+    TrainHandle existing = findTrainHandle(trainid);
+    if (existing != NO_HANDLE && trains_[existing].exists)
+    {
+        return false;
+    }
+
+    // Resolve every stop first so that nothing is changed if one doesn't exist
+    Train newTrain;
+    newTrain.route.reserve(stationtimes.size());
+    for (const auto &stop : stationtimes)
+    {
+        StationHandle station = findStationHandle(stop.first);
+        if (station == NO_HANDLE || !stations_[station].exists)
+        {
+            return false;
+        }
+        newTrain.route.emplace_back(station, stop.second);
+    }
+
+    TrainHandle train = internTrain(trainid);
+
+    // Add departure to all stations on the route and link each stop to the next one
+    for (std::size_t i = 0; i < newTrain.route.size(); i++)
+    {
+        const auto &stop = newTrain.route[i];
+        insertDeparture(stations_[stop.first], std::make_pair(stop.second, train));
+
+        if (i > 0)
+        {
+            const auto &previous = newTrain.route[i - 1];
+            addSuccessor(stations_[previous.first], stop.first, {train, previous.second, stop.second});
+        }
+    }
+
+    newTrain.exists = true;
+    trains_[train] = std::move(newTrain);
+    graphDirty_ = true;
+    return true;
+}
+
+/**
+ * @brief Datastructures::add_trains Adds several trains at once
+ * @param trains ID and stops of each train
+ * @return Were the trains added? Nothing is added if a train already exists or is given twice, or a stop doesn't exist
+ */
+bool Datastructures::add_trains(std::vector<std::pair<TrainID, std::vector<std::pair<StationID, Time>>>> const& trains)
+{
+    // Check every train first so that nothing is added on failure
+    std::unordered_set<std::string_view> ids;
+    ids.reserve(trains.size());
+    std::vector<std::vector<std::pair<StationHandle, Time>>> routes(trains.size());
+    std::size_t stopCount = 0;
+    for (std::size_t i = 0; i < trains.size(); ++i)
+    {
+        const auto &[trainid, stationtimes] = trains[i];
+        TrainHandle existing = findTrainHandle(trainid);
+        if ((existing != NO_HANDLE && trains_[existing].exists) || !ids.insert(trainid).second)
+        {
+            return false;
+        }
+
+        routes[i].reserve(stationtimes.size());
+        for (const auto &stop : stationtimes)
+        {
+            StationHandle station = findStationHandle(stop.first);
+            if (station == NO_HANDLE || !stations_[station].exists)
+            {
+                return false;
+            }
+            routes[i].emplace_back(station, stop.second);
+        }
+        stopCount += stationtimes.size();
+    }
+
+    reserve(0, 0, trains.size());
+
+    std::vector<std::pair<StationHandle, Departure>> departures;
+    departures.reserve(stopCount);
+    for (std::size_t i = 0; i < trains.size(); ++i)
+    {
+        TrainHandle train = internTrain(trains[i].first);
+        auto &route = routes[i];
+
+        for (std::size_t j = 0; j < route.size(); ++j)
+        {
+            departures.emplace_back(route[j].first, std::make_pair(route[j].second, train));
+            if (j > 0)
+            {
+                addSuccessor(stations_[route[j - 1].first], route[j].first, {train, route[j - 1].second, route[j].second});
+            }
+        }
+
+        trains_[train].exists = true;
+        trains_[train].route = std::move(route);
+    }
+
+    // Like add_train(), a stop already departing at the same time isn't added twice
+    mergeDepartures(departures, true);
+    graphDirty_ = true;
+    return true;
+}
+
+/**
+ * @brief Datastructures::next_stations_from Get all next stops from the given station
+ * @param id Station ID
+ * @return A vector holding all next stops (not sorted in any way)
+ */
+std::vector<StationID> Datastructures::next_stations_from(StationID id)
+{
+    std::vector<StationID> result;
+
+    Station* station = findStation(id);
+    if (station == nullptr)
+    {
+        result.push_back(NO_STATION);
+        return result;
+    }
+
+    // Successors are unique per station, no need to filter duplicates
+    result.reserve(station->successors.size());
+    for (const auto &successor : station->successors)
+    {
+        result.push_back(stationIds_[successor.station]);
+    }
+
+    return result;
+}
+
+
+/**
+ * @brief Datastructures::train_stations_from Gets every stop for a train after a given station
+ * @param stationid Station ID
+ * @param trainid Train ID
+ * @return A vector containing the stations
+ */
+std::vector<StationID> Datastructures::train_stations_from(StationID stationid, TrainID trainid)
+{
+    auto view = train_stations_from_view(stationid, trainid);
+
+    if (!view || view->empty())
+    {
+        return {NO_STATION};
+    }
+
+    return std::vector<StationID>(view->begin(), view->end());
+}
+
+/**
+ * @brief Datastructures::train_stations_from_view Gets every stop for a train after a given station without copying the IDs
+ * @param stationid Station ID
+ * @param trainid Train ID
+ * @return A view of the stations, valid until the next change. std::nullopt if the train doesn't stop at the station.
+ */
+std::optional<Datastructures::View<Datastructures::StopIterator>> Datastructures::train_stations_from_view(StationID stationid, TrainID trainid)
+{
+    TrainHandle trainHandle = findTrainHandle(trainid);
+    StationHandle stationHandle = findStationHandle(stationid);
+
+    if (trainHandle == NO_HANDLE || !trains_[trainHandle].exists
+            || stationHandle == NO_HANDLE || !stations_[stationHandle].exists)
+    {
+        return std::nullopt;
+    }
+
+    const auto &route = trains_[trainHandle].route;
+    auto stopIt = std::find_if(route.begin(), route.end(), [stationHandle](auto a){return a.first == stationHandle;});
+
+    if (stopIt == route.end())
+    {
+        return std::nullopt;
+    }
+
+    const std::pair<StationHandle, Time>* first = route.data() + (stopIt - route.begin()) + 1;
+    const std::pair<StationHandle, Time>* last = route.data() + route.size();
+    return View<StopIterator>(StopIterator(&stationIds_, first), StopIterator(&stationIds_, last), last - first);
+}
+
+/**
+ * @brief Datastructures::clear_trains Removes train data from the program
+ */
+void Datastructures::clear_trains()
+{
+    for (auto &train : trains_)
+    {
+        train = Train();
+    }
+
+    for (auto &station : stations_)
+    {
+        station.departures.clear();
+        station.successors.clear();
+    }
+
+    graphDirty_ = true;
+}
+
+/**
+ * @brief Datastructures::remove_train Removes a train with its departures and legs
+ * @param trainid Train ID
+ * @return Was the removal successful?
+ */
+bool Datastructures::remove_train(TrainID trainid)
+{
+    TrainHandle train = findTrainHandle(trainid);
+    if (train == NO_HANDLE || !trains_[train].exists)
+    {
+        return false;
+    }
+
+    // The handle stays reserved for the ID
+    Train removed = std::move(trains_[train]);
+    trains_[train] = Train();
+
+    const auto &route = removed.route;
+    for (std::size_t i = 0; i < route.size(); i++)
+    {
+        Station &station = stations_[route[i].first];
+
+        Departure departure(route[i].second, train);
+        auto &departures = station.departures;
+        auto departureIt = std::lower_bound(departures.begin(), departures.end(), departure, DepartureLess{&trainIds_});
+        if (departureIt != departures.end() && *departureIt == departure)
+        {
+            departures.erase(departureIt);
+        }
+
+        if (i + 1 < route.size())
+        {
+            removeLeg(station, route[i + 1].first, {train, route[i].second, route[i + 1].second});
+        }
+    }
+
+    graphDirty_ = true;
+    return true;
+}
+
+/**
+ * @brief Datastructures::route_any Finds a route between two given stations
+ * @param fromid Departure station
+ * @param toid Destination station
+ * @return A Vector contatining the full route
+ */
+std::vector<std::pair<StationID, Distance>> Datastructures::route_any(StationID fromid, StationID toid)
+{
+    std::vector<std::pair<StationID, Distance>> route;
+
+    if (findStation(fromid) == nullptr || findStation(toid) == nullptr)
+    {
+        route.push_back(std::make_pair(NO_STATION, NO_DISTANCE));
+        return route;
+    }
+
+    // Traverse possible routes with dfs on the graph snapshot
+
+    const RailGraph& graph = railGraph();
+
+    if (!routeDFS(graph, findStationHandle(fromid), findStationHandle(toid)))
+    {
+        return route; // route not found
+    }
+
+    // The search stack holds the route from the source to the destination
+    const auto &queue = scratch_.stack;
+    double distance = 0;
+    route.reserve(queue.size());
+
+    for (auto it = queue.begin(); it < queue.end(); it++)
+    {
+        if (it != queue.begin())
+        {
+            distance += euclideanDistance2(graph.locations[(it - 1)->first], graph.locations[it->first]);
+        }
+
+        route.push_back(std::make_pair(stationIds_[it->first], distance));
+    }
+
+    return route;
+}
+
+/**
+ * @brief Datastructures::route_least_stations Finds the route with the least stations between two given stations
+ * @param fromid Departure station
+ * @param toid Destination station
+ * @return A vector containing the full route
+ */
+std::vector<std::pair<StationID, Distance>> Datastructures::route_least_stations(StationID fromid, StationID toid)
+{
+    std::vector<std::pair<StationID, Distance>> route;
+
+    if (findStation(fromid) == nullptr || findStation(toid) == nullptr)
+    {
+        route.push_back(std::make_pair(NO_STATION, NO_DISTANCE));
+        return route;
+    }
+
+    StationHandle destination = findStationHandle(toid);
+
+    if (!routeBFS(railGraph(), findStationHandle(fromid), destination))
+    {
+        return route; // route not found
+    }
+
+    return routeFromParents(destination);
+}
+
+std::vector<StationID> Datastructures::route_with_cycle(StationID /*fromid*/)
+{
+    // Replace the line below with your implementation
+    // Also uncomment parameters ( /* param */ -> param )
+    throw NotImplemented("route_with_cycle()");
+}
+
+/**
+ * @brief Datastructures::route_shortest_distance Finds the shortest route between two given stations
+ * @param fromid Departure station
+ * @param toid Destination station
+ * @return A vector containing the full route
+ */
+std::vector<std::pair<StationID, Distance>> Datastructures::route_shortest_distance(StationID fromid, StationID toid)
+{
+    std::vector<std::pair<StationID, Distance>> route;
+
+    if (findStation(fromid) == nullptr || findStation(toid) == nullptr)
+    {
+        route.push_back(std::make_pair(NO_STATION, NO_DISTANCE));
+        return route;
+    }
+
+    StationHandle destination = findStationHandle(toid);
+
+    if (!routeAStar(railGraph(), findStationHandle(fromid), destination))
+    {
+        return route; // route not found
+    }
+
+    return routeFromParents(destination);
+}
+
+/**
+ * @brief Datastructures::route_earliest_arrival Finds the route that arrives earliest to the destination
+ * @param fromid Departure station
+ * @param toid Destination station
+ * @param starttime Earliest time of departure
+ * @return A vector containing the departure time from every station on the route and the arrival time to the destination
+ */
+std::vector<std::pair<StationID, Time>> Datastructures::route_earliest_arrival(StationID fromid, StationID toid, Time starttime)
+{
+    std::vector<std::pair<StationID, Time>> route;
+
+    if (findStation(fromid) == nullptr || findStation(toid) == nullptr)
+    {
+        route.push_back(std::make_pair(NO_STATION, NO_TIME));
+        return route;
+    }
+
+    const RailGraph& graph = railGraph();
+    StationHandle source = findStationHandle(fromid);
+    StationHandle destination = findStationHandle(toid);
+
+    if (!routeConnectionScan(graph, source, destination, starttime))
+    {
+        return route; // route not found
+    }
+
+    // Collect the connections backwards from the destination
+    std::vector<const Connection*> legs;
+    for (StationHandle stop = destination; stop != source && legs.size() < stations_.size(); )
+    {
+        legs.push_back(&graph.connections[scratch_.parent[stop]]);
+        stop = legs.back()->from;
+    }
+
+    route.reserve(legs.size() + 1);
+    for (auto it = legs.rbegin(); it != legs.rend(); it++)
+    {
+        route.push_back(std::make_pair(stationIds_[(*it)->from], (*it)->departure));
+    }
+    route.push_back(std::make_pair(toid, scratch_.arrival[destination]));
+
+    return route;
+}
+
+/**
+ * @brief Datastructures::route_pareto_journeys Finds the journeys that trade arrival time against the number of trains used
+ * @param fromid Departure station
+ * @param toid Destination station
+ * @param starttime Earliest time of departure
+ * @return Every Pareto-optimal journey, fewest trains first
+ */
+std::vector<std::vector<std::tuple<StationID, TrainID, Time>>> Datastructures::route_pareto_journeys(StationID fromid, StationID toid, Time starttime)
+{
+    std::vector<std::vector<std::tuple<StationID, TrainID, Time>>> journeys;
+
+    if (findStation(fromid) == nullptr || findStation(toid) == nullptr)
+    {
+        journeys.push_back({std::make_tuple(NO_STATION, NO_TRAIN, NO_TIME)});
+        return journeys;
+    }
+
+    StationHandle source = findStationHandle(fromid);
+    StationHandle destination = findStationHandle(toid);
+
+    for (unsigned int last : routeRaptor(railGraph(), source, destination, starttime))
+    {
+        std::vector<std::tuple<StationID, TrainID, Time>> journey;
+
+        // Follow the boarded trains backwards to the starting label
+        for (unsigned int label = last; scratch_.labels[label].train != NO_HANDLE; )
+        {
+            const JourneyLabel &ride = scratch_.labels[label];
+            label = ride.boardLabel;
+            journey.push_back(std::make_tuple(stationIds_[scratch_.labels[label].stop], trainIds_[ride.train], ride.boardTime));
+        }
+
+        std::reverse(journey.begin(), journey.end());
+        journey.push_back(std::make_tuple(toid, NO_TRAIN, scratch_.labels[last].arrival));
+        journeys.push_back(std::move(journey));
+    }
+
+    return journeys;
+}
+
+/**
+ * @brief Datastructures::railGraph Gets the graph snapshot of the network, rebuilding it if stations or trains have changed
+ * @return The up to date graph snapshot
+ */
+const Datastructures::RailGraph& Datastructures::railGraph()
+{
+    if (!graphDirty_)
+    {
+        return graph_;
+    }
+
+    RailGraph graph;
+    graph.locations.reserve(stations_.size());
+    graph.offsets.reserve(stations_.size() + 1);
+    graph.offsets.push_back(0);
+    graph.legOffsets.push_back(0);
+
+    for (const auto &station : stations_)
+    {
+        graph.locations.push_back(station.location);
+    }
+
+    for (StationHandle handle = 0; handle < stations_.size(); ++handle)
+    {
+        const Station &station = stations_[handle];
+
+        for (const auto &successor : station.successors)
+        {
+            if (!stations_[successor.station].exists)
+            {
+                continue; // The next stop has been removed
+            }
+
+            graph.targets.push_back(successor.station);
+            graph.lengths.push_back(euclideanDistance2(station.location, graph.locations[successor.station]));
+
+            for (const auto &leg : successor.legs)
+            {
+                graph.legDepartures.push_back(leg.departure);
+                graph.legArrivals.push_back(leg.arrival);
+                graph.legTrains.push_back(leg.train);
+
+                // Legs past midnight don't fit the single-day timetable
+                if (leg.arrival >= leg.departure)
+                {
+                    graph.connections.push_back({leg.departure, leg.arrival, handle, successor.station, leg.train});
+                }
+            }
+            graph.legOffsets.push_back(graph.legTrains.size());
+        }
+
+        graph.offsets.push_back(graph.targets.size());
+    }
+
+    // Split the trains into trips along the legs that still exist, a removed
+    // departure or station ends the trip like the midnight does
+    std::vector<std::tuple<TrainHandle, StationHandle, Time, StationHandle, Time>> live;
+    live.reserve(graph.connections.size());
+    for (const auto &connection : graph.connections)
+    {
+        live.emplace_back(connection.train, connection.from, connection.departure, connection.to, connection.arrival);
+    }
+    std::sort(live.begin(), live.end());
+
+    for (TrainHandle handle = 0; handle < trains_.size(); ++handle)
+    {
+        const auto &route = trains_[handle].route;
+        bool onTrip = false;
+
+        for (unsigned int i = 0; i + 1 < route.size(); ++i)
+        {
+            auto leg = std::make_tuple(handle, route[i].first, route[i].second, route[i + 1].first, route[i + 1].second);
+            if (!std::binary_search(live.begin(), live.end(), leg))
+            {
+                onTrip = false;
+                continue;
+            }
+
+            if (!onTrip)
+            {
+                graph.tripOffsets.push_back(graph.tripStops.size());
+                graph.tripTrains.push_back(handle);
+                graph.tripStops.push_back(route[i]);
+                onTrip = true;
+            }
+            graph.tripStops.push_back(route[i + 1]);
+        }
+    }
+    graph.tripOffsets.push_back(graph.tripStops.size());
+
+    // Index the calls of every trip by station
+    graph.callOffsets.assign(stations_.size() + 1, 0);
+    for (const auto &stop : graph.tripStops)
+    {
+        graph.callOffsets[stop.first + 1]++;
+    }
+    std::partial_sum(graph.callOffsets.begin(), graph.callOffsets.end(), graph.callOffsets.begin());
+
+    graph.calls.resize(graph.callOffsets.back());
+    std::vector<unsigned int> callCursor(graph.callOffsets.begin(), graph.callOffsets.end() - 1);
+    for (unsigned int trip = 0; trip < graph.tripTrains.size(); ++trip)
+    {
+        for (unsigned int i = graph.tripOffsets[trip]; i < graph.tripOffsets[trip + 1]; ++i)
+        {
+            graph.calls[callCursor[graph.tripStops[i].first]++] = std::make_pair(trip, i - graph.tripOffsets[trip]);
+        }
+    }
+
+    // Arrivals come before departures at the same moment, so that
+    // zero-minute transfers are scanned in order
+    std::sort(graph.connections.begin(), graph.connections.end(),
+              [](const Connection &a, const Connection &b)
+              {
+                  return a.departure < b.departure || (a.departure == b.departure && a.arrival < b.arrival);
+              });
+
+    graph_ = std::move(graph);
+    graphDirty_ = false;
+    return graph_;
+}
+
+/**
+ * @brief Datastructures::resetScratch Starts a new search in the search workspace
+ * @param stationCount Number of station handles the search may visit
+ */
+void Datastructures::resetScratch(std::size_t stationCount)
+{
+    if (scratch_.visited.size() < stationCount)
+    {
+        scratch_.visited.resize(stationCount, scratch_.generation);
+        scratch_.parent.resize(stationCount, NO_HANDLE);
+    }
+
+    scratch_.generation++;
+
+    // On wrap-around, old stamps could match again
+    if (scratch_.generation == 0)
+    {
+        std::fill(scratch_.visited.begin(), scratch_.visited.end(), 0);
+        std::fill(scratch_.boarded.begin(), scratch_.boarded.end(), 0);
+        scratch_.generation = 1;
+    }
+}
+
+/**
+ * @brief Datastructures::routeDFS Search for a route with an iterative Depth First Search.
+ * Stations are explored in the same order as a recursive search would, and
+ * on success scratch_.stack holds the route from source to destination.
+ * @param graph Graph snapshot of the network
+ * @param source Departure station handle
+ * @param destination Destination station handle
+ * @return Was a route found?
+ */
+bool Datastructures::routeDFS(const RailGraph &graph, StationHandle source, StationHandle destination)
+{
+    auto &visited = scratch_.visited;
+    auto &stack = scratch_.stack;
+
+    resetScratch(graph.locations.size());
+    stack.clear();
+
+    visited[source] = scratch_.generation;
+    stack.push_back(std::make_pair(source, graph.offsets[source]));
+
+    while (!stack.empty())
+    {
+        auto &[station, edge] = stack.back();
+
+        if (station == destination) // route found
+        {
+            return true;
+        }
+
+        if (edge == graph.offsets[station + 1])
+        {
+            stack.pop_back(); // Reached a leaf that isn't the destination
+            continue;
+        }
+
+        StationHandle stop = graph.targets[edge++];
+
+        if (visited[stop] != scratch_.generation)
+        {
+            visited[stop] = scratch_.generation;
+            stack.push_back(std::make_pair(stop, graph.offsets[stop]));
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Datastructures::routeBFS Search for the route with the least stations with Breadth First Search.
+ * On success the route can be followed backwards from the destination in scratch_.parent.
+ * @param graph Graph snapshot of the network
+ * @param source Departure station handle
+ * @param destination Destination station handle
+ * @return Was a route found?
+ */
+bool Datastructures::routeBFS(const RailGraph &graph, StationHandle source, StationHandle destination)
+{
+    auto &visited = scratch_.visited;
+    auto &parent = scratch_.parent;
+    auto &frontier = scratch_.frontier;
+
+    resetScratch(graph.locations.size());
+    frontier.clear();
+
+    visited[source] = scratch_.generation;
+    parent[source] = NO_HANDLE;
+    frontier.push_back(source);
+
+    // The frontier vector is used as a queue, 'next' being its head
+    for (std::size_t next = 0; next < frontier.size(); next++)
+    {
+        StationHandle station = frontier[next];
+
+        if (station == destination) // route found
+        {
+            return true;
+        }
+
+        for (unsigned int edge = graph.offsets[station]; edge < graph.offsets[station + 1]; edge++)
+        {
+            StationHandle stop = graph.targets[edge];
+
+            if (visited[stop] != scratch_.generation)
+            {
+                visited[stop] = scratch_.generation;
+                parent[stop] = station;
+                frontier.push_back(stop);
+            }
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Datastructures::routeAStar Search for the shortest route with A*.
+ * The straight-line distance to the destination never overestimates the
+ * remaining track length, so the first time the destination is popped its
+ * route is the shortest one. On success the route can be followed backwards
+ * from the destination in scratch_.parent.
+ * @param graph Graph snapshot of the network
+ * @param source Departure station handle
+ * @param destination Destination station handle
+ * @return Was a route found?
+ */
+bool Datastructures::routeAStar(const RailGraph &graph, StationHandle source, StationHandle destination)
+{
+    auto &visited = scratch_.visited;
+    auto &parent = scratch_.parent;
+    auto &distance = scratch_.distance;
+
+    resetScratch(graph.locations.size());
+    if (distance.size() < graph.locations.size())
+    {
+        distance.resize(graph.locations.size());
+    }
+    heap_.reset(graph.locations.size());
+
+    const Coord target = graph.locations[destination];
+
+    visited[source] = scratch_.generation;
+    parent[source] = NO_HANDLE;
+    distance[source] = 0;
+    heap_.push(source, euclideanDistance2(graph.locations[source], target));
+
+    while (!heap_.empty())
+    {
+        StationHandle station = heap_.pop();
+
+        if (station == destination) // route found
+        {
+            return true;
+        }
+
+        for (unsigned int edge = graph.offsets[station]; edge < graph.offsets[station + 1]; edge++)
+        {
+            StationHandle stop = graph.targets[edge];
+            double stopDistance = distance[station] + graph.lengths[edge];
+
+            if (visited[stop] != scratch_.generation || stopDistance < distance[stop])
+            {
+                visited[stop] = scratch_.generation;
+                parent[stop] = station;
+                distance[stop] = stopDistance;
+                heap_.push(stop, stopDistance + euclideanDistance2(graph.locations[stop], target));
+            }
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Datastructures::routeConnectionScan Search for the earliest arrival with the Connection Scan Algorithm.
+ * The departure-sorted connections are scanned once, starting from the first
+ * one leaving at 'starttime' and stopping as soon as no later connection can
+ * improve the arrival to the destination. On success the last connection
+ * reaching each station is in scratch_.parent and the arrival times in
+ * scratch_.arrival.
+ * @param graph Graph snapshot of the network
+ * @param source Departure station handle
+ * @param destination Destination station handle
+ * @param starttime Earliest time of departure
+ * @return Was a route found?
+ */
+bool Datastructures::routeConnectionScan(const RailGraph &graph, StationHandle source, StationHandle destination, Time starttime)
+{
+    auto &visited = scratch_.visited;
+    auto &parent = scratch_.parent;
+    auto &arrival = scratch_.arrival;
+    auto &boarded = scratch_.boarded;
+    auto &aboard = scratch_.aboard;
+
+    resetScratch(graph.locations.size());
+    if (arrival.size() < graph.locations.size())
+    {
+        arrival.resize(graph.locations.size());
+    }
+    if (boarded.size() < trains_.size())
+    {
+        boarded.resize(trains_.size(), 0);
+        aboard.resize(trains_.size(), NO_HANDLE);
+    }
+
+    visited[source] = scratch_.generation;
+    arrival[source] = starttime;
+
+    if (source == destination)
+    {
+        return true;
+    }
+
+    auto first = std::lower_bound(graph.connections.begin(), graph.connections.end(), starttime,
+                                  [](const Connection &a, Time time){return a.departure < time;});
+
+    for (auto it = first; it != graph.connections.end(); it++)
+    {
+        const Connection &connection = *it;
+
+        if (visited[destination] == scratch_.generation && arrival[destination] <= connection.departure)
+        {
+            break; // No later connection can arrive earlier
+        }
+
+        // The train can be caught at this stop, or the passenger is already on board.
+        // A removed leg leaves a gap in the train's connections, which can't be ridden over
+        bool onBoard = boarded[connection.train] == scratch_.generation && aboard[connection.train] == connection.from;
+        if (!onBoard && (visited[connection.from] != scratch_.generation || arrival[connection.from] > connection.departure))
+        {
+            continue;
+        }
+
+        boarded[connection.train] = scratch_.generation;
+        aboard[connection.train] = connection.to;
 
+        if (visited[connection.to] != scratch_.generation || connection.arrival < arrival[connection.to])
+        {
+            visited[connection.to] = scratch_.generation;
+            arrival[connection.to] = connection.arrival;
+            parent[connection.to] = it - graph.connections.begin();
+        }
     }
 
-    trains_.insert(std::make_pair(trainid, newTrain));
-    return true;
+    return visited[destination] == scratch_.generation;
 }
 
 /**
- * @brief Datastructures::next_stations_from Get all next stops from the given station
- * @param id Station ID
- * @return A vector holding all next stops (not sorted in any way)
+ * @brief Datastructures::routeRaptor Search for Pareto-optimal journeys with RAPTOR (Round-bAsed Public Transit Optimized Router).
+ * Round k scans every trip (see RailGraph) calling at a station improved in round k-1 and
+ * so finds the earliest arrivals using at most k trains. Whenever a round
+ * improves the arrival to the destination, the journey using that many
+ * trains is Pareto-optimal. The labels are left in scratch_.labels.
+ * @param graph Graph snapshot of the network
+ * @param source Departure station handle
+ * @param destination Destination station handle
+ * @param starttime Earliest time of departure
+ * @return Label of the destination for each Pareto-optimal journey, fewest trains first
  */
-std::vector<StationID> Datastructures::next_stations_from(StationID id)
+std::vector<unsigned int> Datastructures::routeRaptor(const RailGraph &graph, StationHandle source, StationHandle destination, Time starttime)
 {
-    // Compile a vector of next stations of every train in departures
+    auto &visited = scratch_.visited;
+    auto &arrival = scratch_.arrival;
+    auto &label = scratch_.label;
+    auto &labels = scratch_.labels;
+    auto &queued = scratch_.queued;
+    auto &trips = scratch_.trips;
+    auto &marked = scratch_.frontier;
+
+    resetScratch(graph.locations.size());
+    // Sized separately, the other searches only grow 'arrival'
+    if (arrival.size() < graph.locations.size())
+    {
+        arrival.resize(graph.locations.size());
+    }
+    if (label.size() < graph.locations.size())
+    {
+        label.resize(graph.locations.size());
+    }
+    if (queued.size() < graph.tripTrains.size())
+    {
+        queued.resize(graph.tripTrains.size(), NO_HANDLE);
+    }
+    labels.clear();
+    marked.clear();
 
-    // Automatically get rid of duplicates with set, then convert to vector
-    std::unordered_set<StationID> nextStations;
-    std::vector<StationID> result;
+    std::vector<unsigned int> journeys;
 
-    auto stationIt = stations_.find(id);
-    if (stationIt == stations_.end())
+    visited[source] = scratch_.generation;
+    arrival[source] = starttime;
+    label[source] = 0;
+    labels.push_back({0, source, starttime, NO_HANDLE, NO_HANDLE, NO_TIME, NO_HANDLE});
+    marked.push_back(source);
+
+    if (source == destination)
     {
-        nextStations.insert(NO_STATION);
-        result.assign(nextStations.begin(), nextStations.end());
-        return result;
+        journeys.push_back(0);
+        return journeys;
     }
 
-    const Train* currentTrain;
-    for (const auto &departure : stationIt->second.departures)
+    for (unsigned int round = 1; !marked.empty(); ++round)
     {
-        for (const auto &train : departure.second)
+        // Collect the trips calling at the marked stations, scanning each from its first marked stop
+        trips.clear();
+        for (StationHandle station : marked)
         {
-            auto trainIt = trains_.find(train);
-            if (trainIt == trains_.end())
+            for (unsigned int call = graph.callOffsets[station]; call < graph.callOffsets[station + 1]; ++call)
             {
-                return result;
+                auto [trip, stop] = graph.calls[call];
+                if (queued[trip] == NO_HANDLE)
+                {
+                    trips.push_back(trip);
+                    queued[trip] = stop;
+                }
+                queued[trip] = std::min(queued[trip], stop);
             }
+        }
+        marked.clear();
 
-            currentTrain = &trainIt->second;
-
-            // Assuming that the current station is found in its trains (shouldn't exist otherwise)
-            auto stationIt = std::find_if(currentTrain->route.begin(), currentTrain->route.end(), [id](auto a){return a.first == id;});
-            stationIt++;
+        for (unsigned int trip : trips)
+        {
+            TrainHandle train = graph.tripTrains[trip];
+            unsigned int boardLabel = NO_HANDLE;
+            Time boardTime = NO_TIME;
 
-            if (stationIt != currentTrain->route.end())
+            for (unsigned int i = graph.tripOffsets[trip] + queued[trip]; i < graph.tripOffsets[trip + 1]; ++i)
             {
-                nextStations.insert(stationIt->first);
+                auto [stop, time] = graph.tripStops[i];
+
+                // Get off here if that improves both this stop and the destination
+                if (boardLabel != NO_HANDLE
+                        && (visited[stop] != scratch_.generation || time < arrival[stop])
+                        && (visited[destination] != scratch_.generation || time < arrival[destination]))
+                {
+                    unsigned int earlier = visited[stop] == scratch_.generation ? label[stop] : NO_HANDLE;
+                    labels.push_back({round, stop, time, train, boardLabel, boardTime, earlier});
+
+                    visited[stop] = scratch_.generation;
+                    arrival[stop] = time;
+                    label[stop] = labels.size() - 1;
+                    marked.push_back(stop);
+                }
+
+                // Get on here if the stop was reached in the previous rounds
+                if (boardLabel == NO_HANDLE && visited[stop] == scratch_.generation)
+                {
+                    unsigned int reached = label[stop];
+                    while (reached != NO_HANDLE && labels[reached].round == round)
+                    {
+                        reached = labels[reached].earlier;
+                    }
+
+                    if (reached != NO_HANDLE && labels[reached].arrival <= time)
+                    {
+                        boardLabel = reached;
+                        boardTime = time;
+                    }
+                }
             }
+        }
+
+        for (unsigned int trip : trips)
+        {
+            queued[trip] = NO_HANDLE;
+        }
 
+        if (visited[destination] == scratch_.generation && labels[label[destination]].round == round)
+        {
+            journeys.push_back(label[destination]);
         }
     }
 
-    result.reserve(nextStations.size());
-    result.assign(nextStations.begin(), nextStations.end());
-    return result;
+    return journeys;
 }
 
-
 /**
- * @brief Datastructures::train_stations_from Gets every stop for a train after a given station
- * @param stationid Station ID
- * @param trainid Train ID
- * @return A vector containing the stations
+ * @brief Datastructures::routeFromParents Builds a route by following scratch_.parent back from the destination
+ * @param destination Destination station handle
+ * @return A vector containing the full route with cumulative distances
  */
-std::vector<StationID> Datastructures::train_stations_from(StationID stationid, TrainID trainid)
+std::vector<std::pair<StationID, Distance>> Datastructures::routeFromParents(StationHandle destination)
 {
-    std::vector<StationID> stops;
-    const Train* train;
-
-    auto trainIt = trains_.find(trainid);
-    auto stationIt = stations_.find(stationid);
+    std::vector<StationHandle> stops;
 
-    if (trainIt == trains_.end() || stationIt == stations_.end())
+    for (StationHandle stop = destination; stop != NO_HANDLE; stop = scratch_.parent[stop])
     {
-        stops.push_back(NO_STATION);
-        return stops;
+        stops.push_back(stop);
     }
 
-    train = &trainIt->second;
-    auto stopIt = std::find_if(train->route.begin(), train->route.end(), [stationid](auto a){return a.first == stationid;});
+    std::reverse(stops.begin(), stops.end());
+
+    std::vector<std::pair<StationID, Distance>> route;
+    route.reserve(stops.size());
+    Distance distance = 0;
 
-    if (stopIt == train->route.end())
+    // Every leg is truncated on its own, like the distances reported for single legs
+    for (auto it = stops.begin(); it < stops.end(); it++)
     {
-        stops.push_back(NO_STATION);
-        return stops;
+        if (it != stops.begin())
+        {
+            distance += static_cast<Distance>(euclideanDistance2(stations_[*(it - 1)].location, stations_[*it].location));
+        }
+
+        route.push_back(std::make_pair(stationIds_[*it], distance));
     }
 
-    stopIt++;
-    for (; stopIt != train->route.end(); stopIt++)
+    return route;
+}
+
+/**
+ * @brief Datastructures::StationHeap::reset Empties the heap
+ * @param stationCount Number of station handles that may be pushed
+ */
+void Datastructures::StationHeap::reset(std::size_t stationCount)
+{
+    for (const auto &entry : heap_)
     {
-        stops.push_back(stopIt->first);
+        position_[entry.second] = NOT_QUEUED;
     }
 
-    if (stops.size() == 0)
+    heap_.clear();
+
+    if (position_.size() < stationCount)
     {
-        stops.push_back(NO_STATION);
+        position_.resize(stationCount, NOT_QUEUED);
     }
-
-    return stops;
 }
 
 /**
- * @brief Datastructures::clear_trains Removes train data from the program
+ * @brief Datastructures::StationHeap::push Adds a station to the heap, or lowers its key if it is already queued
+ * @param station Station handle
+ * @param key Priority of the station, smallest first
  */
-void Datastructures::clear_trains()
+void Datastructures::StationHeap::push(StationHandle station, double key)
 {
-    trains_.clear();
+    unsigned int index = position_[station];
+
+    if (index == NOT_QUEUED)
+    {
+        index = heap_.size();
+        heap_.push_back(std::make_pair(key, station));
+        position_[station] = index;
+    }
+    else if (key < heap_[index].first)
+    {
+        heap_[index].first = key;
+    }
+    else
+    {
+        return; // Not an improvement
+    }
+
+    siftUp(index);
 }
 
 /**
- * @brief Datastructures::route_any Finds a route between two given stations
- * @param fromid Departure station
- * @param toid Destination station
- * @return A Vector contatining the full route
+ * @brief Datastructures::StationHeap::pop Removes the station with the smallest key
+ * @return Handle of the removed station
  */
-std::vector<std::pair<StationID, Distance>> Datastructures::route_any(StationID fromid, StationID toid)
+Datastructures::StationHandle Datastructures::StationHeap::pop()
 {
-    std::vector<std::pair<StationID, Distance>> route;
-    std::vector<StationID> queue;
+    StationHandle top = heap_.front().second;
+    position_[top] = NOT_QUEUED;
 
-    auto sourceStationIt = stations_.find(fromid);
-    auto destinationStationIt = stations_.find(toid);
+    auto last = heap_.back();
+    heap_.pop_back();
 
-    if (sourceStationIt == stations_.end() || destinationStationIt == stations_.end())
+    if (!heap_.empty())
     {
-        route.push_back(std::make_pair(NO_STATION, NO_DISTANCE));
-        return route;
+        place(0, last);
+        siftDown(0);
     }
 
-    // Traverse possible routes with dfs
+    return top;
+}
 
-    std::unordered_map<StationID, bool> stationGraph; // Station, is visited?
+/**
+ * @brief Datastructures::StationHeap::place Stores an entry at the given heap index and updates its position
+ */
+void Datastructures::StationHeap::place(unsigned int index, std::pair<double, StationHandle> entry)
+{
+    heap_[index] = entry;
+    position_[entry.second] = index;
+}
 
-    for (const auto &station : stations_)
-    {
-        stationGraph.insert(std::make_pair(station.first, false));
-    }
+/**
+ * @brief Datastructures::StationHeap::siftUp Moves an entry towards the root until the heap order holds
+ */
+void Datastructures::StationHeap::siftUp(unsigned int index)
+{
+    auto entry = heap_[index];
 
-    if (!routeDFS(stationGraph, queue, fromid, toid))
+    while (index > 0)
     {
-        return route; // route not found
+        unsigned int parent = (index - 1) / ARITY;
+
+        if (!(entry.first < heap_[parent].first))
+        {
+            break;
+        }
+
+        place(index, heap_[parent]);
+        index = parent;
     }
 
-    const Station* from;
-    const Station* to;
-    double distance = 0;
+    place(index, entry);
+}
 
-    for (auto it = queue.begin(); it < queue.end(); it++)
+/**
+ * @brief Datastructures::StationHeap::siftDown Moves an entry towards the leaves until the heap order holds
+ */
+void Datastructures::StationHeap::siftDown(unsigned int index)
+{
+    auto entry = heap_[index];
+
+    while (true)
     {
-        if (it != queue.begin())
+        unsigned int firstChild = index * ARITY + 1;
+
+        if (firstChild >= heap_.size())
+        {
+            break;
+        }
+
+        // Find the smallest child
+        unsigned int lastChild = std::min<std::size_t>(firstChild + ARITY, heap_.size());
+        unsigned int smallest = firstChild;
+
+        for (unsigned int child = firstChild + 1; child < lastChild; child++)
+        {
+            if (heap_[child].first < heap_[smallest].first)
+            {
+                smallest = child;
+            }
+        }
+
+        if (!(heap_[smallest].first < entry.first))
         {
-            to = &stations_.find(*it)->second;
-            from = &stations_.find(*(it - 1))->second;
-            distance += euclideanDistance2(from->location, to->location);
+            break;
         }
 
-        route.push_back(std::make_pair(*it, distance));
+        place(index, heap_[smallest]);
+        index = smallest;
     }
 
-    return route;
+    place(index, entry);
 }
 
-std::vector<std::pair<StationID, Distance>> Datastructures::route_least_stations(StationID /*fromid*/, StationID /*toid*/)
+/**
+ * @brief Datastructures::StationGrid::clear Removes every station from the grid
+ */
+void Datastructures::StationGrid::clear()
 {
-    // Replace the line below with your implementation
-    // Also uncomment parameters ( /* param */ -> param )
-    throw NotImplemented("route_least_stations()");
+    *this = StationGrid();
 }
 
-std::vector<StationID> Datastructures::route_with_cycle(StationID /*fromid*/)
+/**
+ * @brief Datastructures::StationGrid::insert Adds a station to the grid, picking a new cell size if the station count has doubled
+ * @param station Station handle
+ * @param xy Station coordinates
+ */
+void Datastructures::StationGrid::insert(StationHandle station, Coord xy)
 {
-    // Replace the line below with your implementation
-    // Also uncomment parameters ( /* param */ -> param )
-    throw NotImplemented("route_with_cycle()");
+    min_ = {std::min(min_.x, xy.x), std::min(min_.y, xy.y)};
+    max_ = {std::max(max_.x, xy.x), std::max(max_.y, xy.y)};
+
+    add(station, xy);
+    count_++;
+
+    if (count_ >= 2 * builtFor_)
+    {
+        rebuild();
+    }
 }
 
-std::vector<std::pair<StationID, Distance>> Datastructures::route_shortest_distance(StationID /*fromid*/, StationID /*toid*/)
+/**
+ * @brief Datastructures::StationGrid::erase Removes a station from the grid, picking a new cell size if only a quarter of the stations remain
+ * @param station Station handle
+ * @param xy Station coordinates
+ */
+void Datastructures::StationGrid::erase(StationHandle station, Coord xy)
 {
-    // Replace the line below with your implementation
-    // Also uncomment parameters ( /* param */ -> param )
-    throw NotImplemented("route_shortest_distance()");
+    auto cellIt = cells_.find(key(cellOf(xy.x), cellOf(xy.y)));
+
+    if (cellIt == cells_.end())
+    {
+        return;
+    }
+
+    Cell &cell = cellIt->second;
+    auto entryIt = std::find(cell.begin(), cell.end(), std::make_pair(xy, station));
+
+    if (entryIt == cell.end())
+    {
+        return;
+    }
+
+    *entryIt = cell.back();
+    cell.pop_back();
+    if (cell.empty())
+    {
+        cells_.erase(cellIt);
+    }
+    count_--;
+
+    if (4 * count_ < builtFor_)
+    {
+        rebuild();
+    }
 }
 
-std::vector<std::pair<StationID, Time>> Datastructures::route_earliest_arrival(StationID /*fromid*/, StationID /*toid*/, Time /*starttime*/)
+/**
+ * @brief Datastructures::StationGrid::find Finds a station at the given coordinates
+ * @param xy Coordinates
+ * @return Station handle, NO_HANDLE if there is no station at the coordinates
+ */
+Datastructures::StationHandle Datastructures::StationGrid::find(Coord xy) const
 {
-    // Replace the line below with your implementation
-    // Also uncomment parameters ( /* param */ -> param )
-    throw NotImplemented("route_earliest_arrival()");
+    auto cellIt = cells_.find(key(cellOf(xy.x), cellOf(xy.y)));
+
+    if (cellIt == cells_.end())
+    {
+        return NO_HANDLE;
+    }
+
+    for (const auto &entry : cellIt->second)
+    {
+        if (entry.first == xy)
+        {
+            return entry.second;
+        }
+    }
+
+    return NO_HANDLE;
 }
 
 /**
- * @brief Datastructures::routeDFS Search for a route with Depth First Search
- * @param graph Map containing every station
- * @param queue The resulting route, if found
- * @param source Departure station
- * @param destination Destination station
- * @return Was a route found?
+ * @brief Datastructures::StationGrid::nearest Finds the stations closest to the given coordinates.
+ * The cells are searched in square rings around the cell of the coordinates. A station
+ * outside ring r is farther than r cells away, so the search stops once k stations
+ * closer than that have been found. Equally far stations are ordered by handle.
+ * @param xy Coordinates
+ * @param k Number of stations to find
+ * @return At most k station handles, closest first
  */
-bool Datastructures::routeDFS(std::unordered_map<StationID, bool> &graph,
-                              std::vector<StationID> &queue, StationID source,
-                              StationID destination)
+std::vector<Datastructures::StationHandle> Datastructures::StationGrid::nearest(Coord xy, unsigned int k) const
 {
-    graph.at(source) = true; // visited
-    queue.push_back(source);
+    std::vector<Candidate> best; // Max-heap
+    best.reserve(k + 1);
 
-    if (source == destination) // route found
+    if (count_ > 0 && k > 0)
     {
-        return true;
+        long long cx = cellOf(xy.x);
+        long long cy = cellOf(xy.y);
+        long long minCx = cellOf(min_.x), maxCx = cellOf(max_.x);
+        long long minCy = cellOf(min_.y), maxCy = cellOf(max_.y);
+
+        // Rings closer than the bounding box have no stations, farther ones are outside it
+        long long firstRing = std::max({0LL, minCx - cx, cx - maxCx, minCy - cy, cy - maxCy});
+        long long lastRing = std::max({cx - minCx, maxCx - cx, cy - minCy, maxCy - cy});
+
+        auto scanEntries = [&](const Cell &cell)
+        {
+            for (const auto &[location, station] : cell)
+            {
+                Candidate next = candidate(xy, location, station);
+
+                if (best.size() < k || next < best.front())
+                {
+                    best.push_back(next);
+                    std::push_heap(best.begin(), best.end());
+                    if (best.size() > k)
+                    {
+                        std::pop_heap(best.begin(), best.end());
+                        best.pop_back();
+                    }
+                }
+            }
+        };
+
+        auto scanCell = [&](long long x, long long y)
+        {
+            auto cellIt = cells_.find(key(x, y));
+            if (cellIt != cells_.end())
+            {
+                scanEntries(cellIt->second);
+            }
+        };
+
+        // Far away outliers can leave most rings empty, so searching rings
+        // never costs more than going through every occupied cell
+        std::size_t ringCells = 0;
+
+        for (long long ring = firstRing; ring <= lastRing; ++ring)
+        {
+            ringCells += ring == 0 ? 1 : 8 * ring;
+            if (ringCells > 2 * cells_.size() + 8)
+            {
+                best.clear();
+                for (const auto &cell : cells_)
+                {
+                    scanEntries(cell.second);
+                }
+                break;
+            }
+
+            long long top = std::max(cy - ring, minCy);
+            long long bottom = std::min(cy + ring, maxCy);
+
+            for (long long y = top; y <= bottom; ++y)
+            {
+                if (y == cy - ring || y == cy + ring)
+                {
+                    // Full row of the ring
+                    for (long long x = std::max(cx - ring, minCx); x <= std::min(cx + ring, maxCx); ++x)
+                    {
+                        scanCell(x, y);
+                    }
+                }
+                else
+                {
+                    // Only the left and right ends of the row
+                    if (cx - ring >= minCx)
+                    {
+                        scanCell(cx - ring, y);
+                    }
+                    if (cx + ring <= maxCx)
+                    {
+                        scanCell(cx + ring, y);
+                    }
+                }
+            }
+
+            // Clamped so that the square fits in 64 bits, a smaller reach only scans more rings
+            long long reach = std::min<long long>(ring * cellSize_, std::numeric_limits<std::uint32_t>::max());
+            if (best.size() == k && best.front().first <= square(reach, 0))
+            {
+                break;
+            }
+        }
+    }
+
+    std::sort_heap(best.begin(), best.end());
+    return handles(best);
+}
+
+/**
+ * @brief Datastructures::StationGrid::withinRadius Finds the stations at most the given distance away from the coordinates
+ * @param xy Coordinates
+ * @param radius Maximum distance
+ * @return Station handles, closest first. Equally far stations are ordered by handle.
+ */
+std::vector<Datastructures::StationHandle> Datastructures::StationGrid::withinRadius(Coord xy, Distance radius) const
+{
+    std::vector<Candidate> found;
+
+    if (count_ == 0 || radius < 0)
+    {
+        return handles(found);
     }
 
-    for (StationID stop : next_stations_from(source))
+    SquaredDistance radius2 = square(radius, 0);
+
+    auto scanEntries = [&](const Cell &cell)
     {
-        if (graph.at(stop) == false)
+        for (const auto &[location, station] : cell)
         {
-            if (routeDFS(graph, queue, stop, destination))
+            Candidate next = candidate(xy, location, station);
+            if (next.first <= radius2)
             {
-                return true;
+                found.push_back(next);
             }
-            else
+        }
+    };
+
+    // Cells overlapping the bounding square of the circle
+    long long left = std::max(cellOf(xy.x - static_cast<long long>(radius)), cellOf(min_.x));
+    long long right = std::min(cellOf(xy.x + static_cast<long long>(radius)), cellOf(max_.x));
+    long long top = std::max(cellOf(xy.y - static_cast<long long>(radius)), cellOf(min_.y));
+    long long bottom = std::min(cellOf(xy.y + static_cast<long long>(radius)), cellOf(max_.y));
+
+    if (left > right || top > bottom)
+    {
+        return handles(found);
+    }
+
+    // A circle covering most of the stations is cheaper to handle cell by cell
+    if (static_cast<double>(right - left + 1) * (bottom - top + 1) > cells_.size())
+    {
+        for (const auto &cell : cells_)
+        {
+            scanEntries(cell.second);
+        }
+    }
+    else
+    {
+        for (long long y = top; y <= bottom; ++y)
+        {
+            for (long long x = left; x <= right; ++x)
             {
-                queue.pop_back(); // Reached a leaf that isn't the destination
+                auto cellIt = cells_.find(key(x, y));
+                if (cellIt != cells_.end())
+                {
+                    scanEntries(cellIt->second);
+                }
             }
         }
     }
 
-    return false;
+    std::sort(found.begin(), found.end());
+    return handles(found);
+}
+
+/**
+ * @brief Datastructures::StationGrid::cellOf Calculates the cell index of a coordinate
+ * @param coord X or y coordinate
+ * @return Cell index, rounded towards negative infinity
+ */
+long long Datastructures::StationGrid::cellOf(long long coord) const
+{
+    long long cell = coord / cellSize_;
+
+    if (coord % cellSize_ < 0)
+    {
+        cell--;
+    }
+
+    return cell;
+}
+
+/**
+ * @brief Datastructures::StationGrid::square Calculates dx*dx + dy*dy without overflow
+ * @param dx Distance along the x axis, less than 2^32
+ * @param dy Distance along the y axis, less than 2^32
+ * @return Squared distance
+ */
+Datastructures::StationGrid::SquaredDistance Datastructures::StationGrid::square(unsigned long long dx, unsigned long long dy)
+{
+    unsigned long long dx2 = dx * dx;
+    unsigned long long sum = dx2 + dy * dy;
+
+    return SquaredDistance(sum < dx2, sum);
+}
+
+/**
+ * @brief Datastructures::StationGrid::candidate Pairs a station with its squared distance from the query coordinates
+ * @param xy Query coordinates
+ * @param location Station coordinates
+ * @param station Station handle
+ * @return Squared distance and station
+ */
+Datastructures::StationGrid::Candidate Datastructures::StationGrid::candidate(Coord xy, Coord location, StationHandle station)
+{
+    long long dx = static_cast<long long>(location.x) - xy.x;
+    long long dy = static_cast<long long>(location.y) - xy.y;
+
+    return Candidate(square(dx < 0 ? -dx : dx, dy < 0 ? -dy : dy), station);
 }
 
+/**
+ * @brief Datastructures::StationGrid::handles Drops the distances of the candidates
+ * @param candidates Candidates sorted by distance
+ * @return Station handles in the same order
+ */
+std::vector<Datastructures::StationHandle> Datastructures::StationGrid::handles(const std::vector<Candidate> &candidates)
+{
+    std::vector<StationHandle> stations;
+    stations.reserve(candidates.size());
+    for (const auto &entry : candidates)
+    {
+        stations.push_back(entry.second);
+    }
+
+    return stations;
+}
+
+/**
+ * @brief Datastructures::StationGrid::key Packs the indices of a cell into a hash key
+ * @param cx Cell index on the x axis
+ * @param cy Cell index on the y axis
+ * @return Key of the cell
+ */
+std::uint64_t Datastructures::StationGrid::key(long long cx, long long cy)
+{
+    return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(cx)) << 32) | static_cast<std::uint32_t>(cy);
+}
+
+/**
+ * @brief Datastructures::StationGrid::add Stores a station in its cell
+ * @param station Station handle
+ * @param xy Station coordinates
+ */
+void Datastructures::StationGrid::add(StationHandle station, Coord xy)
+{
+    cells_[key(cellOf(xy.x), cellOf(xy.y))].push_back(std::make_pair(xy, station));
+}
+
+/**
+ * @brief Datastructures::StationGrid::rebuild Picks the cell size for the current stations and redistributes them
+ */
+void Datastructures::StationGrid::rebuild()
+{
+    Cell entries;
+    entries.reserve(count_);
+    for (const auto &cell : cells_)
+    {
+        entries.insert(entries.end(), cell.second.begin(), cell.second.end());
+    }
+
+    // Shrink the bounding box to the remaining stations
+    min_ = {std::numeric_limits<int>::max(), std::numeric_limits<int>::max()};
+    max_ = {std::numeric_limits<int>::min(), std::numeric_limits<int>::min()};
+    for (const auto &entry : entries)
+    {
+        min_ = {std::min(min_.x, entry.first.x), std::min(min_.y, entry.first.y)};
+        max_ = {std::max(max_.x, entry.first.x), std::max(max_.y, entry.first.y)};
+    }
+
+    // About one station per cell
+    double width = entries.empty() ? 1.0 : static_cast<double>(max_.x) - min_.x + 1;
+    double height = entries.empty() ? 1.0 : static_cast<double>(max_.y) - min_.y + 1;
+    cellSize_ = std::max(1LL, static_cast<long long>(std::ceil(std::sqrt(width * height / std::max(1u, count_)))));
+    builtFor_ = count_;
+
+    cells_.clear();
+    cells_.reserve(count_);
+    for (const auto &entry : entries)
+    {
+        add(entry.second, entry.first);
+    }
+}
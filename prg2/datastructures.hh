@@ -18,11 +18,14 @@
 #include <map>
 #include <set>
 #include <unordered_set>
-#include <list>
 #include <cmath>
 #include <stdexcept>
 #include <algorithm>
-#include <QDebug>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <string_view>
+#include <iosfwd>
 
 // Types for IDs
 using StationID = std::string;
@@ -125,6 +128,11 @@ public:
     // Short rationale for estimate: Average and worst-case complexities of unordered_map find() and insert().
     bool add_station(StationID id, Name const& name, Coord xy);
 
+    // Estimate of performance: O(k), O((n+k)*log(n+k)) in INCREMENTAL ordering mode, k being the number of stations added
+    // Short rationale for estimate: Hash lookups to check the IDs, then one insertion pass, large batches sort the orderings once
+    // Adds every given station, or none of them if an ID already exists or is given twice.
+    bool add_stations(std::vector<std::tuple<StationID, Name, Coord>> const& stations);
+
     // Estimate of performance: Worst-case: O(n)
     // Short rationale for estimate: Average and worst-case complexity of unordered_map find().
     Name get_station_name(StationID id);
@@ -135,32 +143,39 @@ public:
 
     // We recommend you implement the operations below only after implementing the ones above
 
-    // Estimate of performance: O(n*log(n))
-    // Short rationale for estimate: Time complexity of the heaviest operation, std::sort()
+    // Estimate of performance: O(n), O(n*log(n)) after changes in REBUILD mode and always in SORT and RADIX modes
+    // Short rationale for estimate: Walk over the ordered name index, or std::sort()
     std::vector<StationID> stations_alphabetically();
 
-    // Estimate of performance: O(n*log(n))
-    // Short rationale for estimate: Time complexity of the heaviest operation, std::sort()
+    // Estimate of performance: O(n), O(n*log(n)) after changes in REBUILD mode and always in SORT mode
+    // Short rationale for estimate: Walk over the ordered distance index, radix sort with a fixed number of passes, or std::sort()
     std::vector<StationID> stations_distance_increasing();
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: Time complexity of find_if()
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: Hash lookup of the grid cell, which holds about one station
     StationID find_station_with_coord(Coord xy);
 
     // Estimate of performance: Worst-case: O(n)
     // Short rationale for estimate: Time complexity of unordered_map::find()
     bool change_station_coord(StationID id, Coord newcoord);
 
-    // Estimate of performance: Worst-case: O(n)
-    // Short rationale for estimate: Average: map::at() logarithmic, worst-case: map::insert() linear
+    // Estimate of performance: O(d), d being the number of departures from the station
+    // Short rationale for estimate: Binary search, then vector::insert() shifts the later departures
     bool add_departure(StationID stationid, TrainID trainid, Time time);
 
-    // Estimate of performance: Worst-case: O(n)
-    // Short rationale for estimate: Average: map::at() logarithmic, worst-case: map::erase() & map::find() linear
+    // Estimate of performance: O(k*log(k) + d), k being the number of departures added and d the departures of their stations
+    // Short rationale for estimate: The new departures are sorted once and merged with the departures of each station
+    // Adds every given departure, or none of them if a station doesn't exist or a departure exists or is given twice.
+    bool add_departures(std::vector<std::tuple<StationID, TrainID, Time>> const& departures);
+
+    // Estimate of performance: O(d + s + o), d being the departures from the station, s the stops of the train and o the out-degree
+    // Short rationale for estimate: vector::erase() shifts the later departures, the leg to the next stop is searched on the route
+    // Also removes the leg of the train from the station to its next stop, so
+    // every route search, the RAPTOR trips included, stops using it.
     bool remove_departure(StationID stationid, TrainID trainid, Time time);
 
-    // Estimate of performance: Worst-case: O(n^2)
-    // Short rationale for estimate: Iterating through departure times and trains departing at those times, perftest seems to scale linearly
+    // Estimate of performance: O(log(d) + m), m being the number of departures returned
+    // Short rationale for estimate: Binary search in the sorted departures, then a contiguous copy
     std::vector<std::pair<Time, TrainID>> station_departures_after(StationID stationid, Time time);
 
     // We recommend you implement the operations below only after implementing the ones above
@@ -189,38 +204,68 @@ public:
     // Short rationale for estimate: Time complexity of unordered_map::find()
     bool add_station_to_region(StationID id, RegionID parentid);
 
-    // Estimate of performance: Worst-case: O(n)
-    // Short rationale for estimate: Recursive function getParents() calls unordered_map::find() and vector::push_back()
+    // Estimate of performance: O(d), d being the depth of the region tree, O(n) after region changes
+    // Short rationale for estimate: Walk up the parent array of the flattened region tree
     std::vector<RegionID> station_in_regions(StationID id);
 
     // Non-compulsory operations
 
-    // Estimate of performance: Worst-case: O(n^2)
-    // Short rationale for estimate: Recursive unordered_map::find() calls
+    // Estimate of performance: O(m), m being the number of subregions, O(n) after region changes
+    // Short rationale for estimate: The subregions are a contiguous slice of the flattened region tree
     std::vector<RegionID> all_subregions_of_region(RegionID id);
 
-    // Estimate of performance: O(n*log(n))
-    // Short rationale for estimate: Time complexity of std::sort()
+    // Estimate of performance: O(1) for evenly spread stations, worst-case O(n)
+    // Short rationale for estimate: Only the grid cells around the coordinates are searched
     std::vector<StationID> stations_closest_to(Coord xy);
 
+    // Estimate of performance: O(k*log(k)) for evenly spread stations, worst-case O(n*log(k))
+    // Short rationale for estimate: The grid cells around the coordinates are searched until k stations are found
+    std::vector<StationID> stations_closest_k(Coord xy, unsigned int k);
+
+    // Estimate of performance: O(m*log(m)) for evenly spread stations, m being the size of the result, worst-case O(n+m*log(m))
+    // Short rationale for estimate: Only the grid cells overlapping the circle are searched, results are sorted by distance
+    std::vector<StationID> stations_within_radius(Coord xy, Distance radius);
+
     // Estimate of performance: Worst-case: O(n)
     // Short rationale for estimate: unordered_map::find(), unordered_map::erase()
     bool remove_station(StationID id);
 
-    // Estimate of performance: Worst-case: O(n^2)
-    // Short rationale for estimate: At most N1 * N2 comparisons (std::find_first_of), perftest seems to scale linearly
+    // Estimate of performance: O(log(d)), d being the depth of the region tree, O(n*log(d)) after region changes
+    // Short rationale for estimate: Binary lifting over the flattened region tree
     RegionID common_parent_of_regions(RegionID id1, RegionID id2);
 
+    // Estimate of performance: O(m*log(d)), m being the number of pairs, O(n*log(d)) after region changes
+    // Short rationale for estimate: One binary-lifting query per pair on the same region tree
+    // Returns the result of common_parent_of_regions() for each pair.
+    std::vector<RegionID> common_parents_of_regions(std::vector<std::pair<RegionID, RegionID>> const& pairs);
+
+    // Estimate of performance: O(n*(log(r) + c*v)), c being the candidate regions per station and v their vertex count
+    // Short rationale for estimate: R-tree search over the region bounding boxes, then a crossing number test per candidate
+    // Adds every station that doesn't belong to a region yet to the innermost region whose polygon contains it.
+    // Returns the number of stations added.
+    unsigned int assign_stations_to_regions();
+
+    // Estimate of performance: O(log(r) + c*v + k*log(k)), k being the regions found
+    // Short rationale for estimate: Same R-tree search as above for one point, then sorting the result by depth
+    // Returns the regions whose polygon contains the coordinates, the innermost first.
+    std::vector<RegionID> regions_at(Coord xy);
+
     //
     // New assignment 2 operations
     //
 
     // Estimate of performance: O(n)
     // Short rationale for estimate: Linear in count of stops on the route
+    // Nothing is added if a stop doesn't exist.
     bool add_train(TrainID trainid, std::vector<std::pair<StationID, Time>> stationtimes);
 
+    // Estimate of performance: O(s*log(s) + d), s being the number of stops on the routes and d the departures of their stations
+    // Short rationale for estimate: Hash lookups to check the routes, then the departures are merged like in add_departures()
+    // Adds every given train, or none of them if a train exists or is given twice or a stop doesn't exist.
+    bool add_trains(std::vector<std::pair<TrainID, std::vector<std::pair<StationID, Time>>>> const& trains);
+
     // Estimate of performance: O(n)
-    // Short rationale for estimate: Linear in count of neighboring stations
+    // Short rationale for estimate: Linear in the out-degree of the station, successors are precomputed in add_train()
     std::vector<StationID> next_stations_from(StationID id);
 
     // Estimate of performance: O(n)
@@ -228,68 +273,489 @@ public:
     std::vector<StationID> train_stations_from(StationID stationid, TrainID trainid);
 
     // Estimate of performance: O(n)
-    // Short rationale for estimate: Complexity of std::unordered_map::clear()
+    // Short rationale for estimate: Complexity of std::unordered_map::clear() and clearing the departure and successor lists
     void clear_trains();
 
+    // Estimate of performance: O(s*(d + o)), s being the number of stops, d the departures and o the out-degree of a stop
+    // Short rationale for estimate: The route gives the stations, where the departure and the leg to the next stop are erased
+    bool remove_train(TrainID trainid);
+
     // Estimate of performance: O(n)
     // Short rationale for estimate: Complexity of a depth-first search
     std::vector<std::pair<StationID, Distance>> route_any(StationID fromid, StationID toid);
 
     // Non-compulsory operations
 
-    // Estimate of performance:
-    // Short rationale for estimate:
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: Complexity of a breadth-first search
     std::vector<std::pair<StationID, Distance>> route_least_stations(StationID fromid, StationID toid);
 
     // Estimate of performance:
     // Short rationale for estimate:
     std::vector<StationID> route_with_cycle(StationID fromid);
 
-    // Estimate of performance:
-    // Short rationale for estimate:
+    // Estimate of performance: O(n*log(n))
+    // Short rationale for estimate: A* search, each station is pushed to and popped from a heap
     std::vector<std::pair<StationID, Distance>> route_shortest_distance(StationID fromid, StationID toid);
 
-    // Estimate of performance:
-    // Short rationale for estimate:
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: Single scan over the departure-sorted train legs
     std::vector<std::pair<StationID, Time>> route_earliest_arrival(StationID fromid, StationID toid, Time starttime);
 
-    bool routeDFS(std::unordered_map<StationID, bool> &graph, std::vector<StationID> &queue, StationID source, StationID destination);
+    // Estimate of performance: O(k*n)
+    // Short rationale for estimate: RAPTOR scans each train at most once per round, k being the number of rounds (trains used)
+    // Returns every Pareto-optimal journey, fewest trains first. A journey lists the station where each
+    // train is boarded with the train and its departure time, and lastly the destination and arrival time.
+    std::vector<std::vector<std::tuple<StationID, TrainID, Time>>> route_pareto_journeys(StationID fromid, StationID toid, Time starttime);
+
+    // How the orderings of stations_alphabetically() and stations_distance_increasing() are kept.
+    // INCREMENTAL updates them on every station change, REBUILD only marks them stale and
+    // rebuilds them on the next listing, which suits bulk loads. SORT and RADIX keep no
+    // orderings and sort the stations on every listing, RADIX sorting the distances with
+    // an LSD radix sort on their 64-bit squared values.
+    enum class OrderingMode { INCREMENTAL, REBUILD, SORT, RADIX };
+
+    // Estimate of performance: O(1), O(n*log(n)) if switching to INCREMENTAL with stale orderings
+    // Short rationale for estimate: Stale orderings are rebuilt with std::sort()
+    void set_ordering_mode(OrderingMode mode);
+
+    // Estimate of performance: O(n), n being the stations, regions and trains after the additions
+    // Short rationale for estimate: Reserving may reallocate the vectors and rehash the hash tables
+    // Prepares for adding the given numbers of stations, regions and trains, for bulk loads.
+    void reserve(unsigned int stations, unsigned int regions, unsigned int trains);
+
+    // Estimate of performance: O(n), n being the stations, regions, trains and their departures, legs and vertices
+    // Short rationale for estimate: Every record is written once, strings are interned with a hash table
+    // Writes the stations, regions and trains to a binary snapshot. Returns false if writing fails.
+    bool save_snapshot(std::ostream &output);
+
+    // Estimate of performance: O(n), O(n*log(n)) in INCREMENTAL ordering mode
+    // Short rationale for estimate: Every record is checked and copied once, the grid and orderings are rebuilt
+    // Replaces the data with a snapshot written by save_snapshot(). Returns false and
+    // keeps the current data if the snapshot is not valid.
+    bool load_snapshot(std::string_view data);
 
 private:
     // Add stuff needed for your class implementation here
 
+    // Internal 32-bit handles for interned station and train IDs
+    using StationHandle = std::uint32_t;
+    using TrainHandle = std::uint32_t;
+
+    static constexpr std::uint32_t NO_HANDLE = std::numeric_limits<std::uint32_t>::max();
+
+    // A train leaving a station at the given time
+    using Departure = std::pair<Time, TrainHandle>;
+
+    // Orders departures by time, equal times by the external train ID
+    struct DepartureLess
+    {
+        const std::vector<TrainID>* ids;
+        bool operator()(const Departure& a, const Departure& b) const
+        {
+            if (a.first != b.first) { return a.first < b.first; }
+            return (*ids)[a.second] < (*ids)[b.second];
+        }
+    };
+
+    // Orders (key, station) pairs by key, equal keys by the external station ID
+    template <typename Key>
+    struct StationKeyLess
+    {
+        const std::vector<StationID>* ids;
+        bool operator()(const std::pair<Key, StationHandle>& a, const std::pair<Key, StationHandle>& b) const
+        {
+            if (a.first != b.first) { return a.first < b.first; }
+            return (*ids)[a.second] < (*ids)[b.second];
+        }
+    };
+
+    using NameOrder = std::set<std::pair<Name, StationHandle>, StationKeyLess<Name>>;
+    using DistanceOrder = std::set<std::pair<std::int64_t, StationHandle>, StationKeyLess<std::int64_t>>;
+
     struct Region
     {
         Name name;
         std::vector<Coord> vertices;
         RegionID parentRegion;
-        std::list<RegionID> subregions;
+        std::vector<RegionID> subregions;
+    };
+
+    // Region forest flattened in preorder. The subregions of the region at
+    // index i are the contiguous slice (i, end[i]), so "is A inside B" is an
+    // interval check.
+    struct RegionTree
+    {
+        std::unordered_map<RegionID, unsigned int> index; // Preorder index of each region
+        std::vector<RegionID> order; // Regions in preorder
+        std::vector<unsigned int> end; // Indexed by preorder index, end of the subtree slice
+        std::vector<unsigned int> parent; // Indexed by preorder index, NO_HANDLE for roots
+        std::vector<unsigned int> depth; // Indexed by preorder index, 0 for roots
+        std::vector<unsigned int> jumps; // jumps[k * order.size() + i] is the 2^k-th parent of i, NO_HANDLE past the root
+        unsigned int levels = 0;
+
+        // Packed R-tree over the region bounding boxes. The first order.size() boxes
+        // bound the regions (first being the preorder index), the rest are inner nodes
+        // whose children are the boxes [first, last). The root is the last box.
+        struct Box
+        {
+            Coord min;
+            Coord max;
+            unsigned int first;
+            unsigned int last;
+        };
+        std::vector<Box> boxes;
+        std::vector<const std::vector<Coord>*> vertices; // Indexed by preorder index
+
+        bool contains(unsigned int outer, unsigned int inner) const { return outer <= inner && inner < end[outer]; }
+    };
+
+    // A single train leg between two consecutive stops
+    struct Leg
+    {
+        TrainHandle train;
+        Time departure;
+        Time arrival;
+    };
+
+    // A directly reachable station and every train leg leading there
+    struct Successor
+    {
+        StationHandle station;
+        std::vector<Leg> legs;
     };
 
     struct Station
     {
+        bool exists = false;
         Name name;
         Coord location;
         RegionID region;
-        std::map<Time, std::set<TrainID>> departures;
+        std::vector<Departure> departures; // Sorted with DepartureLess
+        std::vector<Successor> successors;
     };
 
     struct Train
     {
-        std::vector<std::pair<StationID, Time>> route;
+        bool exists = false;
+        std::vector<std::pair<StationHandle, Time>> route;
     };
 
-    double euclideanDistance(Coord xy);
-    double euclideanDistance2(Coord xy1, Coord xy2);
+    // A single train leg in the departure-sorted timetable
+    struct Connection
+    {
+        Time departure;
+        Time arrival;
+        StationHandle from;
+        StationHandle to;
+        TrainHandle train;
+    };
+
+    // Immutable compressed sparse row snapshot of the railway network.
+    // Stations are indexed by their handles, the edges leaving station i are
+    // targets[offsets[i]] ... targets[offsets[i+1]-1]. The legs of edge e
+    // are likewise found between legOffsets[e] and legOffsets[e+1].
+    struct RailGraph
+    {
+        std::vector<Coord> locations;
+
+        std::vector<unsigned int> offsets;
+        std::vector<StationHandle> targets;
+        std::vector<double> lengths;
+
+        std::vector<unsigned int> legOffsets;
+        std::vector<Time> legDepartures;
+        std::vector<Time> legArrivals;
+        std::vector<TrainHandle> legTrains;
+
+        // Every leg of every train, sorted by departure time
+        std::vector<Connection> connections;
+
+        // Runs of consecutive existing legs of a train within a single day.
+        // The stops of trip j are tripStops[tripOffsets[j]] ... tripStops[tripOffsets[j+1]-1]
+        std::vector<unsigned int> tripOffsets;
+        std::vector<std::pair<StationHandle, Time>> tripStops;
+        std::vector<TrainHandle> tripTrains;
+
+        // Trips calling at station i and the index of the stop on the trip
+        // are calls[callOffsets[i]] ... calls[callOffsets[i+1]-1]
+        std::vector<unsigned int> callOffsets;
+        std::vector<std::pair<unsigned int, unsigned int>> calls;
+    };
+
+    // Arrival to a station with a given number of trains (the round) in a RAPTOR search
+    struct JourneyLabel
+    {
+        unsigned int round;
+        StationHandle stop;
+        Time arrival;
+        TrainHandle train; // NO_HANDLE for the starting label
+        unsigned int boardLabel; // Label of the station where 'train' was boarded
+        Time boardTime;
+        unsigned int earlier; // Previous label of the same station, NO_HANDLE if none
+    };
 
-    Station* findStation(StationID id); // avg: O(1), worst O(N) unordered_map::find()
+    // Workspace of the route searches, kept between calls so that its
+    // capacity is reused. A station is visited in the current search when
+    // its stamp equals the current generation, so a reset costs O(1).
+    struct SearchScratch
+    {
+        std::vector<unsigned int> visited; // Indexed by StationHandle
+        unsigned int generation = 0;
+        std::vector<StationHandle> parent; // Indexed by StationHandle
+        std::vector<std::pair<StationHandle, unsigned int>> stack; // Station, next edge to try
+        std::vector<StationHandle> frontier;
+        std::vector<double> distance; // Indexed by StationHandle, valid for visited stations
+        std::vector<Time> arrival; // Indexed by StationHandle, valid for visited stations
+        std::vector<unsigned int> boarded; // Indexed by TrainHandle, generation stamps like 'visited'
+        std::vector<StationHandle> aboard; // Indexed by TrainHandle, the stop a boarded train has reached, valid for boarded trains
+        std::vector<unsigned int> label; // Indexed by StationHandle, latest JourneyLabel, valid for visited stations
+        std::vector<JourneyLabel> labels;
+        std::vector<unsigned int> queued; // Indexed by trip, first stop to scan in the current round
+        std::vector<unsigned int> trips;
+    };
+
+    // Indexed 4-ary min-heap of stations. Unlike std::priority_queue it
+    // supports decreasing the key of a queued station, so every station is
+    // in the heap at most once.
+    class StationHeap
+    {
+    public:
+        void reset(std::size_t stationCount); // O(size of the heap)
+        bool empty() const { return heap_.empty(); }
+        void push(StationHandle station, double key); // O(log n), inserts or decreases the key
+        StationHandle pop(); // O(log n)
+
+    private:
+        static constexpr unsigned int ARITY = 4;
+        static constexpr unsigned int NOT_QUEUED = std::numeric_limits<unsigned int>::max();
+
+        void place(unsigned int index, std::pair<double, StationHandle> entry);
+        void siftUp(unsigned int index);
+        void siftDown(unsigned int index);
+
+        std::vector<std::pair<double, StationHandle>> heap_; // Key, station
+        std::vector<unsigned int> position_; // Indexed by StationHandle
+    };
 
-    void getParents(RegionID child, std::vector<RegionID> &parents);
-    void getChildren(RegionID parent, std::vector<RegionID> &children);
+    // Hashed uniform grid over the station coordinates. The cell size is
+    // picked from the area and number of the stations so that a cell holds
+    // about one station, and is picked again whenever the count has doubled
+    // or dropped to a quarter. Queries only look at the cells around the
+    // query point, falling back to a linear scan for far away outliers.
+    class StationGrid
+    {
+    public:
+        void clear();
+        void insert(StationHandle station, Coord xy); // Amortized O(1)
+        void erase(StationHandle station, Coord xy); // O(stations in the cell)
+        StationHandle find(Coord xy) const; // O(stations in the cell), NO_HANDLE if none
+        std::vector<StationHandle> nearest(Coord xy, unsigned int k) const; // O(k*log(k)) for evenly spread stations
+        std::vector<StationHandle> withinRadius(Coord xy, Distance radius) const; // O(m*log(m)) for evenly spread stations
+
+    private:
+        using Cell = std::vector<std::pair<Coord, StationHandle>>;
+
+        // Squared distance as its carry and low 64 bits, as it can take 65 bits for int coordinates
+        using SquaredDistance = std::pair<unsigned int, unsigned long long>;
+        using Candidate = std::pair<SquaredDistance, StationHandle>;
+
+        long long cellOf(long long coord) const;
+        static SquaredDistance square(unsigned long long dx, unsigned long long dy);
+        static Candidate candidate(Coord xy, Coord location, StationHandle station);
+        static std::vector<StationHandle> handles(const std::vector<Candidate> &candidates);
+        static std::uint64_t key(long long cx, long long cy);
+        void add(StationHandle station, Coord xy);
+        void rebuild();
+
+        std::unordered_map<std::uint64_t, Cell> cells_;
+        long long cellSize_ = 1;
+        unsigned int count_ = 0;
+        unsigned int builtFor_ = 0; // Station count the cell size was picked for
+        Coord min_ = {std::numeric_limits<int>::max(), std::numeric_limits<int>::max()}; // Bounding box of the stations
+        Coord max_ = {std::numeric_limits<int>::min(), std::numeric_limits<int>::min()};
+    };
+
+public:
+    // Read-only views over the internal storage, for reading without copying IDs.
+    // A view is valid until the next change to the data structures.
+
+    template <typename Iterator>
+    class View
+    {
+    public:
+        View() = default;
+        View(Iterator first, Iterator last, std::size_t size) : first_{first}, last_{last}, size_{size} {}
+
+        Iterator begin() const { return first_; }
+        Iterator end() const { return last_; }
+        std::size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+    private:
+        Iterator first_{};
+        Iterator last_{};
+        std::size_t size_ = 0;
+    };
+
+    // Iterates departures as (time, train ID) pairs
+    class DepartureIterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<Time, TrainID>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = std::pair<Time, TrainID const&>;
+
+        DepartureIterator() = default;
+        DepartureIterator(const std::vector<TrainID>* ids, const Departure* departure) : ids_{ids}, departure_{departure} {}
+
+        reference operator*() const { return {departure_->first, (*ids_)[departure_->second]}; }
+        DepartureIterator& operator++() { ++departure_; return *this; }
+        bool operator==(DepartureIterator const& other) const { return departure_ == other.departure_; }
+        bool operator!=(DepartureIterator const& other) const { return departure_ != other.departure_; }
+
+    private:
+        const std::vector<TrainID>* ids_ = nullptr;
+        const Departure* departure_ = nullptr;
+    };
+
+    // Iterates the stops of a train route as station IDs
+    class StopIterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = StationID;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const StationID*;
+        using reference = StationID const&;
+
+        StopIterator() = default;
+        StopIterator(const std::vector<StationID>* ids, const std::pair<StationHandle, Time>* stop) : ids_{ids}, stop_{stop} {}
+
+        reference operator*() const { return (*ids_)[stop_->first]; }
+        StopIterator& operator++() { ++stop_; return *this; }
+        bool operator==(StopIterator const& other) const { return stop_ == other.stop_; }
+        bool operator!=(StopIterator const& other) const { return stop_ != other.stop_; }
+
+    private:
+        const std::vector<StationID>* ids_ = nullptr;
+        const std::pair<StationHandle, Time>* stop_ = nullptr;
+    };
+
+    // Iterates the existing stations as station IDs, skipping removed ones
+    class StationIterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = StationID;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const StationID*;
+        using reference = StationID const&;
+
+        StationIterator() = default;
+        StationIterator(const Datastructures* ds, StationHandle handle) : ds_{ds}, handle_{handle} { skipRemoved(); }
+
+        reference operator*() const { return ds_->stationIds_[handle_]; }
+        StationIterator& operator++() { ++handle_; skipRemoved(); return *this; }
+        bool operator==(StationIterator const& other) const { return handle_ == other.handle_; }
+        bool operator!=(StationIterator const& other) const { return handle_ != other.handle_; }
+
+    private:
+        void skipRemoved()
+        {
+            while (handle_ < ds_->stations_.size() && !ds_->stations_[handle_].exists) { ++handle_; }
+        }
+
+        const Datastructures* ds_ = nullptr;
+        StationHandle handle_ = 0;
+    };
+
+    // Estimate of performance: O(log(d)), d being the number of departures from the station
+    // Short rationale for estimate: Binary search in the sorted departures, nothing is copied
+    // Returns std::nullopt if the station doesn't exist.
+    std::optional<View<DepartureIterator>> station_departures_after_view(StationID stationid, Time time);
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: The view walks the station slots lazily
+    View<StationIterator> all_stations_view();
+
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: Linear search for the stop in the train route, nothing is copied
+    // Returns std::nullopt if the station or train doesn't exist or the train doesn't stop at the station.
+    std::optional<View<StopIterator>> train_stations_from_view(StationID stationid, TrainID trainid);
+
+    // Estimate of performance: O(1) on average
+    // Short rationale for estimate: unordered_map::find(), nothing is copied
+    // Returns std::nullopt if the region doesn't exist.
+    std::optional<View<const Coord*>> get_region_coords_view(RegionID id);
+
+private:
+
+    static std::int64_t squaredDistance(Coord xy); // Squared distance from the origin, no overflow
+    void orderStation(StationHandle handle); // O(log(n)) in INCREMENTAL mode, otherwise O(1)
+    void unorderStation(StationHandle handle); // O(log(n)) in INCREMENTAL mode, otherwise O(1)
+    void rebuildOrders(); // O(n*log(n))
+    std::vector<std::pair<Name, StationHandle>> nameKeys(); // O(n)
+    std::vector<std::pair<std::int64_t, StationHandle>> distanceKeys(); // O(n)
+    void radixSort(std::vector<std::pair<std::int64_t, StationHandle>> &keys); // O(n), ties sorted by ID
+
+    double euclideanDistance2(Coord xy1, Coord xy2);
 
-    std::unordered_map<StationID, Station> stations_;
+    StationHandle internStation(StationID const &id); // avg: O(1), worst O(N) unordered_map::insert()
+    TrainHandle internTrain(TrainID const &id); // avg: O(1), worst O(N) unordered_map::insert()
+    StationHandle findStationHandle(StationID const &id); // avg: O(1), worst O(N) unordered_map::find()
+    TrainHandle findTrainHandle(TrainID const &id); // avg: O(1), worst O(N) unordered_map::find()
+
+    Station* findStation(StationID const &id); // avg: O(1), worst O(N) unordered_map::find()
+
+    bool insertDeparture(Station &station, Departure const &departure); // O(log(d)) search, O(d) insert
+    bool mergeDepartures(std::vector<std::pair<StationHandle, Departure>> &departures, bool allowDuplicates); // O(k*log(k) + d)
+    void addSuccessor(Station &from, StationHandle to, Leg const &leg); // O(out-degree)
+    void removeLeg(Station &from, StationHandle to, Leg const &leg); // O(out-degree + legs)
+
+    const RailGraph& railGraph(); // O(1) if up to date, otherwise O(V+E) rebuild
+    void resetScratch(std::size_t stationCount); // Amortized O(1)
+    bool routeDFS(const RailGraph &graph, StationHandle source, StationHandle destination); // O(V+E)
+    bool routeBFS(const RailGraph &graph, StationHandle source, StationHandle destination); // O(V+E)
+    bool routeAStar(const RailGraph &graph, StationHandle source, StationHandle destination); // O((V+E)*log(V))
+    bool routeConnectionScan(const RailGraph &graph, StationHandle source, StationHandle destination, Time starttime); // O(C)
+    std::vector<unsigned int> routeRaptor(const RailGraph &graph, StationHandle source, StationHandle destination, Time starttime); // O(k*(V+T))
+    std::vector<std::pair<StationID, Distance>> routeFromParents(StationHandle destination);
+
+    const RegionTree& regionTree(); // O(1) if up to date, otherwise O(n) rebuild
+    void getParents(RegionID child, std::vector<RegionID> &parents); // O(depth)
+    RegionID commonParent(const RegionTree &tree, RegionID id1, RegionID id2); // O(log(depth))
+    void buildRegionBoxes(RegionTree &tree); // O(r*log(r))
+    void regionsAt(const RegionTree &tree, Coord xy, std::vector<unsigned int> &found); // O(log(r) + candidates*vertices)
+    static bool polygonContains(std::vector<Coord> const &vertices, Coord xy); // O(vertices)
+
+    // Interning tables. A handle is assigned to an ID the first time it is
+    // added and stays fixed, so removed stations keep their handles.
+    std::unordered_map<StationID, StationHandle> stationHandles_;
+    std::vector<StationID> stationIds_;
+    std::unordered_map<TrainID, TrainHandle> trainHandles_;
+    std::vector<TrainID> trainIds_;
+
+    std::vector<Station> stations_; // Indexed by StationHandle
+    std::vector<Train> trains_; // Indexed by TrainHandle
+    unsigned int stationCount_ = 0;
     std::unordered_map<RegionID, Region> regions_;
-    std::unordered_map<TrainID, Train> trains_;
+    RegionTree regionTree_;
+    bool regionsDirty_ = true;
+
+    RailGraph graph_;
+    bool graphDirty_ = true;
+    SearchScratch scratch_;
+    StationHeap heap_;
+    StationGrid grid_; // Spatial index of the existing stations
+
+    // Existing stations by name and by distance from the origin
+    NameOrder byName_{StationKeyLess<Name>{&stationIds_}};
+    DistanceOrder byDistance_{StationKeyLess<std::int64_t>{&stationIds_}};
+    OrderingMode orderingMode_ = OrderingMode::INCREMENTAL;
+    bool ordersDirty_ = false; // Set when a change isn't reflected in the orderings
 
 };
 
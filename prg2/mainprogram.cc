@@ -30,6 +30,7 @@ using std::ostream;
 
 #include <fstream>
 using std::ifstream;
+using std::ofstream;
 
 #include <sstream>
 using std::istringstream;
@@ -45,12 +46,8 @@ using std::make_tuple;
 using std::get;
 using std::tie;
 
-#include <regex>
-using std::regex_match;
-using std::regex_search;
-using std::smatch;
-using std::regex;
-using std::sregex_token_iterator;
+#include <string_view>
+using std::string_view;
 
 #include <algorithm>
 using std::find_if;
@@ -61,6 +58,7 @@ using std::max;
 using std::min;
 using std::shuffle;
 using std::sort;
+using std::clamp;
 
 #include <random>
 using std::minstd_rand;
@@ -71,6 +69,7 @@ using std::uniform_int_distribution;
 #include <functional>
 using std::function;
 using std::equal_to;
+using std::ref;
 
 #include <vector>
 using std::vector;
@@ -112,6 +111,21 @@ using std::back_inserter;
 #include <cstddef>
 #include <cassert>
 
+#include <charconv>
+using std::from_chars;
+
+#include <thread>
+using std::thread;
+
+// Files are memory-mapped on POSIX systems and read into memory elsewhere
+#if defined(__unix__) || defined(__APPLE__)
+#define USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 
 #include "mainprogram.hh"
 
@@ -123,6 +137,403 @@ using std::back_inserter;
 
 string const MainProgram::PROMPT = "> ";
 
+// Parameter patterns of the commands, in the notation of ParamScanner below
+string const stationidx = "i";
+string const trainidx = "i";
+string const regionidx = "n";
+string const namex = "q";
+string const timex = "t";
+string const numx = "n";
+string const coordx = "c";
+string const wsx = "_";
+string const filenamex = "f";
+string const regionpairx = regionidx+"':'"+regionidx;
+string const stationtimex = stationidx+"':'"+timex;
+
+string_view const SPACES = " \t\n\v\f\r";
+
+/*
+ * Hand-written scanner for command parameters. A pattern is a string of elements:
+ *   i      identifier [a-zA-Z0-9-]+
+ *   n      number [0-9]+
+ *   t      time HHMM between 0000 and 2359
+ *   w      word [0-9a-zA-Z_]+
+ *   q      "name", [ a-zA-Z0-9-]+ between quotes
+ *   f      "filename", [-a-zA-Z0-9 ./:_]+ between quotes
+ *   c      coordinates (x,y), whitespace allowed inside the parentheses
+ *   _      one or more whitespace characters
+ *   *      rest of the line up to a line break
+ *   'text' literal text
+ *   (...)  part whose whole text is captured, the elements inside capture nothing
+ *   [...]  optional part
+ *   {...}  part repeated zero or more times, the elements inside capture nothing
+ *   a|b    alternatives, the first one matching is used
+ * Elements i, n, t, w, q and f capture their text (q and f without the quotes) and c
+ * captures x and y. Captures of optional parts and alternatives that didn't match are empty.
+ * Each element consumes as much as it can and a part that fails is undone as a whole, there
+ * is no other backtracking. That suffices for the command grammar, as every element ends
+ * where whitespace, a quote or punctuation that the element can't contain begins.
+ */
+class MainProgram::ParamScanner
+{
+public:
+    explicit ParamScanner(string_view text) : text_(text) {}
+
+    // Matches the whole text against the pattern, allowing trailing whitespace
+    bool match(string_view pattern, Matches& matches, std::size_t& count)
+    {
+        matches_ = &matches;
+        count_ = 0;
+        bool matched = alternatives(pattern);
+        whitespace();
+        count = count_;
+        return matched && pos_ == text_.size();
+    }
+
+    // Matches the pattern at the next non-whitespace character, for walking through lists that
+    // the command pattern has already accepted. Returns false at the end of the text.
+    bool next(string_view pattern, Matches& matches)
+    {
+        whitespace();
+        if (pos_ == text_.size()) { return false; }
+
+        matches_ = &matches;
+        count_ = 0;
+        return alternatives(pattern);
+    }
+
+private:
+    string_view text_;
+    std::size_t pos_ = 0;
+    Matches* matches_ = nullptr;
+    std::size_t count_ = 0;
+    bool capturing_ = true;
+
+    static bool is_space(char c) { return SPACES.find(c) != string_view::npos; }
+    static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+    static bool is_alnum(char c) { return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+    static bool is_id(char c) { return is_alnum(c) || c == '-'; }
+    static bool is_word(char c) { return is_alnum(c) || c == '_'; }
+    static bool is_name(char c) { return is_id(c) || c == ' '; }
+    static bool is_filename(char c) { return is_id(c) || c == ' ' || c == '.' || c == '/' || c == ':' || c == '_'; }
+
+    // Index of the character closing the part that opens at pattern[open], or of the quote ending a literal
+    static std::size_t closing(string_view pattern, std::size_t open)
+    {
+        if (pattern[open] == '\'') { return pattern.find('\'', open + 1); }
+
+        unsigned int depth = 0;
+        for (std::size_t i = open; i < pattern.size(); ++i)
+        {
+            char c = pattern[i];
+            if (c == '\'') { i = pattern.find('\'', i + 1); }
+            else if (c == '(' || c == '[' || c == '{') { ++depth; }
+            else if ((c == ')' || c == ']' || c == '}') && --depth == 0) { return i; }
+        }
+        assert(false && "Unbalanced parameter pattern!");
+        return pattern.size();
+    }
+
+    // Index of the '|' ending the first alternative of the pattern, npos if there's only one
+    static std::size_t alternative_end(string_view pattern)
+    {
+        for (std::size_t i = 0; i < pattern.size(); ++i)
+        {
+            char c = pattern[i];
+            if (c == '|') { return i; }
+            if (c == '\'' || c == '(' || c == '[' || c == '{') { i = closing(pattern, i); }
+        }
+        return string_view::npos;
+    }
+
+    bool capture(std::size_t begin, std::size_t end)
+    {
+        if (capturing_)
+        {
+            assert(count_ < matches_->size() && "Too many captures in parameter pattern!");
+            (*matches_)[count_++] = {text_.substr(begin, end - begin)};
+        }
+        return true;
+    }
+
+    bool alternatives(string_view pattern)
+    {
+        bool matched = false;
+        for (;;)
+        {
+            auto end = alternative_end(pattern);
+            auto alternative = pattern.substr(0, end);
+            if (matched)
+            {
+                skip(alternative);
+            }
+            else
+            {
+                auto pos = pos_;
+                auto count = count_;
+                matched = sequence(alternative);
+                if (!matched)
+                {
+                    pos_ = pos;
+                    count_ = count;
+                    skip(alternative);
+                }
+            }
+            if (end == string_view::npos) { return matched; }
+            pattern.remove_prefix(end + 1);
+        }
+    }
+
+    // Leaves the captures of a part that didn't match empty
+    void skip(string_view pattern)
+    {
+        for (std::size_t i = 0; i < pattern.size(); ++i)
+        {
+            switch (pattern[i])
+            {
+                case 'i': case 'n': case 't': case 'w': case 'q': case 'f': case '(':
+                    capture(pos_, pos_);
+                    break;
+                case 'c':
+                    capture(pos_, pos_);
+                    capture(pos_, pos_);
+                    break;
+                default:
+                    break;
+            }
+            if (pattern[i] == '[')
+            {
+                auto close = closing(pattern, i);
+                skip(pattern.substr(i + 1, close - i - 1));
+                i = close;
+            }
+            else if (pattern[i] == '\'' || pattern[i] == '(' || pattern[i] == '{')
+            {
+                i = closing(pattern, i);
+            }
+        }
+    }
+
+    bool sequence(string_view pattern)
+    {
+        for (std::size_t i = 0; i < pattern.size(); ++i)
+        {
+            auto begin = pos_;
+            bool matched = true;
+            switch (pattern[i])
+            {
+                case '_': matched = whitespace(); break;
+                case 'i': matched = chars(is_id) && capture(begin, pos_); break;
+                case 'n': matched = chars(is_digit) && capture(begin, pos_); break;
+                case 'w': matched = chars(is_word) && capture(begin, pos_); break;
+                case 't': matched = time() && capture(begin, pos_); break;
+                case 'q': matched = quoted(is_name); break;
+                case 'f': matched = quoted(is_filename); break;
+                case 'c': matched = coord(); break;
+                case '*': pos_ = std::min(text_.find_first_of("\r\n", pos_), text_.size()); break;
+                case '\'':
+                {
+                    auto close = closing(pattern, i);
+                    auto literal = pattern.substr(i + 1, close - i - 1);
+                    matched = text_.substr(pos_, literal.size()) == literal;
+                    if (matched) { pos_ += literal.size(); }
+                    i = close;
+                    break;
+                }
+                case '(':
+                {
+                    auto close = closing(pattern, i);
+                    bool capturing = capturing_;
+                    capturing_ = false;
+                    matched = alternatives(pattern.substr(i + 1, close - i - 1));
+                    capturing_ = capturing;
+                    if (matched) { capture(begin, pos_); }
+                    i = close;
+                    break;
+                }
+                case '[':
+                {
+                    auto close = closing(pattern, i);
+                    auto optional = pattern.substr(i + 1, close - i - 1);
+                    auto count = count_;
+                    if (!alternatives(optional))
+                    {
+                        pos_ = begin;
+                        count_ = count;
+                        skip(optional);
+                    }
+                    i = close;
+                    break;
+                }
+                case '{':
+                {
+                    auto close = closing(pattern, i);
+                    auto repeated = pattern.substr(i + 1, close - i - 1);
+                    bool capturing = capturing_;
+                    capturing_ = false;
+                    for (auto pos = pos_; ; pos = pos_)
+                    {
+                        if (!alternatives(repeated) || pos_ == pos)
+                        {
+                            pos_ = pos;
+                            break;
+                        }
+                    }
+                    capturing_ = capturing;
+                    i = close;
+                    break;
+                }
+                default:
+                    assert(false && "Unknown element in parameter pattern!");
+            }
+
+            if (!matched) { return false; }
+        }
+        return true;
+    }
+
+    bool whitespace()
+    {
+        auto begin = pos_;
+        while (pos_ < text_.size() && is_space(text_[pos_])) { ++pos_; }
+        return pos_ != begin;
+    }
+
+    bool chars(bool (*accept)(char))
+    {
+        auto begin = pos_;
+        while (pos_ < text_.size() && accept(text_[pos_])) { ++pos_; }
+        return pos_ != begin;
+    }
+
+    bool literal(char c)
+    {
+        if (pos_ < text_.size() && text_[pos_] == c) { ++pos_; return true; }
+        return false;
+    }
+
+    bool time()
+    {
+        if (text_.size() - pos_ < 4) { return false; }
+        auto hh = text_.substr(pos_, 2);
+        bool hours = (hh[0] == '0' || hh[0] == '1') ? is_digit(hh[1]) : (hh[0] == '2' && hh[1] >= '0' && hh[1] <= '3');
+        if (!hours || text_[pos_+2] < '0' || text_[pos_+2] > '5' || !is_digit(text_[pos_+3])) { return false; }
+        pos_ += 4;
+        return true;
+    }
+
+    bool quoted(bool (*accept)(char))
+    {
+        if (!literal('"')) { return false; }
+        auto begin = pos_;
+        if (!chars(accept)) { return false; }
+        auto end = pos_;
+        if (!literal('"')) { return false; }
+        capture(begin, end);
+        return true;
+    }
+
+    bool coord()
+    {
+        if (!literal('(')) { return false; }
+        whitespace();
+        auto xbegin = pos_;
+        if (!chars(is_digit)) { return false; }
+        auto xend = pos_;
+        whitespace();
+        if (!literal(',')) { return false; }
+        whitespace();
+        auto ybegin = pos_;
+        if (!chars(is_digit)) { return false; }
+        auto yend = pos_;
+        whitespace();
+        if (!literal(')')) { return false; }
+        capture(xbegin, xend);
+        capture(ybegin, yend);
+        return true;
+    }
+};
+
+// Read-only contents of a whole file, for parsing it in place
+class MainProgram::MappedFile
+{
+public:
+    explicit MappedFile(string const& filename)
+    {
+#ifdef USE_MMAP
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd >= 0)
+        {
+            struct stat info;
+            if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode))
+            {
+                size_ = static_cast<std::size_t>(info.st_size);
+                void* data = (size_ > 0) ? ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+                if (data != MAP_FAILED)
+                {
+                    if (data) { ::madvise(data, size_, MADV_SEQUENTIAL); }
+                    data_ = static_cast<char const*>(data);
+                    mapped_ = (data != nullptr);
+                    open_ = true;
+                }
+            }
+            ::close(fd);
+        }
+        if (open_) { return; }
+#endif
+        // No mmap available or it failed, read the file instead
+        ifstream input(filename, std::ios::binary);
+        if (input)
+        {
+            buffer_.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+            data_ = buffer_.data();
+            size_ = buffer_.size();
+            open_ = true;
+        }
+    }
+
+    ~MappedFile()
+    {
+#ifdef USE_MMAP
+        if (mapped_) { ::munmap(const_cast<char*>(data_), size_); }
+#endif
+    }
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    bool is_open() const { return open_; }
+    string_view text() const { return {data_, size_}; }
+
+private:
+    char const* data_ = nullptr;
+    std::size_t size_ = 0;
+    bool mapped_ = false;
+    bool open_ = false;
+    string buffer_;
+};
+
+/**
+ * @brief MainProgram::split_command Splits a command line into <whitespace>command(<whitespace>parameters)
+ * @param line Command line
+ * @param cmd Command name
+ * @param params Rest of the line after the whitespace following the command name
+ */
+void MainProgram::split_command(string_view line, string_view& cmd, string_view& params)
+{
+    auto cmdbegin = min(line.find_first_not_of(SPACES), line.size());
+    auto cmdend = min(line.find_first_of(SPACES, cmdbegin), line.size());
+    cmd = line.substr(cmdbegin, cmdend - cmdbegin);
+    params = line.substr(min(line.find_first_not_of(SPACES, cmdend), line.size()));
+}
+
+template <typename To>
+bool MainProgram::parse_number(string_view text, To& result)
+{
+    auto [end, error] = from_chars(text.data(), text.data() + text.size(), result);
+    return error == std::errc() && end == text.data() + text.size();
+}
+
 void MainProgram::test_get_functions(StationID id)
 {
     ds_.get_station_name(id);
@@ -277,22 +688,22 @@ MainProgram::CmdResult MainProgram::cmd_station_departures_after(std::ostream &o
     Time time = convert_string_to<Time>(*begin++);
     assert( begin == end && "Impossible number of parameters!");
 
-    auto departures = ds_.station_departures_after(stationid, time);
+    auto departures = ds_.station_departures_after_view(stationid, time);
 
-    if (departures.size() == 1 && departures.front() == std::make_pair(NO_TIME, NO_TRAIN))
+    if (!departures)
     {
         output << "No such station (NO_TIME, NO_TRAIN returned)" << endl;
         return {};
     }
 
-    if (!departures.empty())
+    if (!departures->empty())
     {
         output << "Departures from station ";
         print_station_brief(stationid, output, false);
         output << " after ";
         print_time(time, output, false);
         output << ":" << endl;
-        for (auto& [deptime, trainid] : departures)
+        for (auto [deptime, trainid] : *departures)
         {
             output << " " << trainid << " at ";
             print_time(deptime, output);
@@ -328,15 +739,14 @@ MainProgram::CmdResult MainProgram::cmd_add_train(std::ostream& output, MatchIte
 
     CmdResultTrains result;
     std::vector<std::pair<StationID,Time>> stationtimes;
-    smatch stationtime;
-    auto sbeg = stationtimesstr.cbegin();
-    auto send = stationtimesstr.cend();
+    Matches stationtime;
+    ParamScanner scanner(stationtimesstr);
     StationID prevstation = NO_STATION;
     Time prevtime = NO_TIME;
-    for ( ; regex_search(sbeg, send, stationtime, stationtimes_regex_); sbeg = stationtime.suffix().first)
+    while (scanner.next(stationtimex, stationtime))
     {
-        StationID stationid = stationtime[1];
-        Time time = convert_string_to<Time>(stationtime[2]);
+        StationID stationid = stationtime[0];
+        Time time = convert_string_to<Time>(stationtime[1]);
         if (prevstation != NO_STATION)
         {
             result.push_back({trainid, prevstation, stationid, prevtime});
@@ -448,6 +858,46 @@ MainProgram::CmdResult MainProgram::cmd_stations_closest_to(std::ostream &output
     return {ResultType::IDLIST, CmdResultIDs{{}, stations}};
 }
 
+MainProgram::CmdResult MainProgram::cmd_stations_closest_k(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    string xstr = *begin++;
+    string ystr = *begin++;
+    string kstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    int x = convert_string_to<int>(xstr);
+    int y = convert_string_to<int>(ystr);
+    unsigned int k = convert_string_to<unsigned int>(kstr);
+
+    auto stations = ds_.stations_closest_k({x,y}, k);
+    if (stations.empty())
+    {
+        output << "No stations!" << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{{}, stations}};
+}
+
+MainProgram::CmdResult MainProgram::cmd_stations_within_radius(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    string xstr = *begin++;
+    string ystr = *begin++;
+    string radiusstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    int x = convert_string_to<int>(xstr);
+    int y = convert_string_to<int>(ystr);
+    Distance radius = convert_string_to<Distance>(radiusstr);
+
+    auto stations = ds_.stations_within_radius({x,y}, radius);
+    if (stations.empty())
+    {
+        output << "No stations!" << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{{}, stations}};
+}
+
 MainProgram::CmdResult MainProgram::cmd_common_parent_of_regions(std::ostream &output, MatchIter begin, MatchIter end)
 {
     RegionID regionid1 = convert_string_to<RegionID>(*begin++);
@@ -464,6 +914,67 @@ MainProgram::CmdResult MainProgram::cmd_common_parent_of_regions(std::ostream &o
     return {ResultType::IDLIST, CmdResultIDs{{regionid1, regionid2, regionid}, {}}};
 }
 
+MainProgram::CmdResult MainProgram::cmd_common_parents_of_regions(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    string regionpairsstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    std::vector<std::pair<RegionID, RegionID>> regionpairs;
+    Matches regionpair;
+    ParamScanner scanner(regionpairsstr);
+    while (scanner.next(regionpairx, regionpair))
+    {
+        regionpairs.push_back({convert_string_to<RegionID>(regionpair[0]), convert_string_to<RegionID>(regionpair[1])});
+    }
+
+    auto regionids = ds_.common_parents_of_regions(regionpairs);
+
+    for (std::size_t i = 0; i < regionpairs.size(); ++i)
+    {
+        output << regionpairs[i].first << " & " << regionpairs[i].second << ": ";
+        if (i < regionids.size() && regionids[i] != NO_REGION)
+        {
+            print_region(regionids[i], output);
+        }
+        else
+        {
+            output << "No common parent region found." << endl;
+        }
+    }
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_assign_stations_to_regions(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto assigned = ds_.assign_stations_to_regions();
+    output << "Assigned " << assigned << " stations to regions." << endl;
+
+    view_dirty = true;
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_regions_at(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    string xstr = *begin++;
+    string ystr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    int x = convert_string_to<int>(xstr);
+    int y = convert_string_to<int>(ystr);
+
+    auto regionids = ds_.regions_at({x,y});
+    if (regionids.empty())
+    {
+        output << "No regions at the coordinates." << endl;
+    }
+
+    return {ResultType::IDLIST, CmdResultIDs{regionids, {}}};
+}
+
 MainProgram::CmdResult MainProgram::cmd_station_in_regions(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
 {
     StationID id = *begin++;
@@ -523,6 +1034,11 @@ void MainProgram::test_remove_station()
 
 void MainProgram::add_random_stations_regions(unsigned int size, Coord min, Coord max)
 {
+    // Stations are added as one batch, after which they can be added to the regions
+    vector<std::tuple<StationID, Name, Coord>> stations;
+    vector<pair<StationID, RegionID>> stationregions;
+    stations.reserve(size);
+
     for (unsigned int i = 0; i < size; ++i)
     {
         auto name = n_to_name(random_stations_added_);
@@ -531,7 +1047,7 @@ void MainProgram::add_random_stations_regions(unsigned int size, Coord min, Coor
         int x = random<int>(min.x, max.x);
         int y = random<int>(min.y, max.y);
 
-        ds_.add_station(id, name, {x, y});
+        stations.emplace_back(id, name, Coord{x, y});
 
         // Add a new region for every 10 stations
         if (random_stations_added_ % 10 == 0)
@@ -556,11 +1072,25 @@ void MainProgram::add_random_stations_regions(unsigned int size, Coord min, Coor
         if (random_regions_added_ > 0 && random(0,2) == 0)
         {
             auto rid = n_to_regionid(random<decltype(random_regions_added_)>(0, random_regions_added_));
-            ds_.add_station_to_region(id, rid);
+            stationregions.emplace_back(id, rid);
         }
 
         ++random_stations_added_;
     }
+
+    // If some ID is already taken, add the rest one at a time
+    if (!ds_.add_stations(stations))
+    {
+        for (auto const& [id, name, xy] : stations)
+        {
+            ds_.add_station(id, name, xy);
+        }
+    }
+
+    for (auto const& [id, rid] : stationregions)
+    {
+        ds_.add_station_to_region(id, rid);
+    }
 }
 
 MainProgram::CmdResult MainProgram::cmd_random_stations(ostream& output, MatchIter begin, MatchIter end)
@@ -585,7 +1115,7 @@ MainProgram::CmdResult MainProgram::cmd_random_stations(ostream& output, MatchIt
     }
     else
     {
-        auto stations = ds_.all_stations();
+        auto stations = ds_.all_stations_view();
         if (!stations.empty())
         {
             // Find out bounding box
@@ -646,18 +1176,18 @@ MainProgram::CmdResult MainProgram::cmd_train_stations_from(std::ostream& output
  string trainid = *begin++;
  assert( begin == end && "Impossible number of parameters!");
 
- auto opresult = ds_.train_stations_from(stationid, trainid);
+ auto opresult = ds_.train_stations_from_view(stationid, trainid);
 
- if (opresult.size() == 1 && opresult.front() == NO_STATION)
+ if (!opresult || opresult->empty())
  {
      output << "Unsuccessful, operation returned {NO_STATION}." << endl;
      return {};
  }
 
  CmdResultRoute result;
- result.reserve(opresult.size());
+ result.reserve(opresult->size());
  auto previd = stationid;
- std::transform(opresult.begin(), opresult.end(), std::back_inserter(result),
+ std::transform(opresult->begin(), opresult->end(), std::back_inserter(result),
                 [&previd](auto& id){ auto res=std::make_tuple(NO_TRAIN, previd, id, NO_TIME, NO_DISTANCE); previd=id; return res; });
  return {ResultType::ROUTE, result};
 }
@@ -666,12 +1196,13 @@ MainProgram::CmdResult MainProgram::cmd_all_stations(ostream& output, MatchIter
 {
     assert( begin == end && "Impossible number of parameters!");
 
-    auto stations = ds_.all_stations();
-    if (stations.empty())
+    auto view = ds_.all_stations_view();
+    if (view.empty())
     {
         output << "No stations!" << endl;
     }
 
+    std::vector<StationID> stations(view.begin(), view.end());
     std::sort(stations.begin(), stations.end());
     return {ResultType::IDLIST, CmdResultIDs{{}, stations}};
 }
@@ -684,12 +1215,11 @@ MainProgram::CmdResult MainProgram::cmd_add_region(std::ostream& /*output*/, Mat
     assert( begin == end && "Impossible number of parameters!");
 
     vector<Coord> coords;
-    smatch coord;
-    auto sbeg = coordsstr.cbegin();
-    auto send = coordsstr.cend();
-    for ( ; regex_search(sbeg, send, coord, coords_regex_); sbeg = coord.suffix().first)
+    Matches coord;
+    ParamScanner scanner(coordsstr);
+    while (scanner.next(coordx, coord))
     {
-        coords.push_back({convert_string_to<int>(coord[1]),convert_string_to<int>(coord[2])});
+        coords.push_back({convert_string_to<int>(coord[0]),convert_string_to<int>(coord[1])});
     }
 
     assert(coords.size() >= 3 && "Region with <3 coords");
@@ -774,6 +1304,8 @@ void MainProgram::add_random_trains(unsigned int n)
 {
     if (random_stations_added_ > 0) // Don't do anything if there's no stations
     {
+        vector<pair<TrainID, vector<pair<StationID, Time>>>> trains;
+        trains.reserve(n);
         for (unsigned int i=0; i<n; ++i)
         {
             auto trainid = n_to_trainid(random_trains_added_++);
@@ -795,7 +1327,16 @@ void MainProgram::add_random_trains(unsigned int n)
                     time -= 2400;
                 }
             }
-            ds_.add_train(trainid, departures);
+            trains.emplace_back(trainid, std::move(departures));
+        }
+
+        // If some train can't be added (e.g. a station has been removed), add the rest one at a time
+        if (!ds_.add_trains(trains))
+        {
+            for (auto const& [trainid, departures] : trains)
+            {
+                ds_.add_train(trainid, departures);
+            }
         }
     }
 }
@@ -985,6 +1526,20 @@ void MainProgram::test_stations_closest_to()
     ds_.stations_closest_to({x,y});
 }
 
+void MainProgram::test_stations_closest_k()
+{
+    int x = random<int>(1, 10000);
+    int y = random<int>(1, 10000);
+    ds_.stations_closest_k({x,y}, random<unsigned int>(1, 20));
+}
+
+void MainProgram::test_stations_within_radius()
+{
+    int x = random<int>(1, 10000);
+    int y = random<int>(1, 10000);
+    ds_.stations_within_radius({x,y}, random<Distance>(0, 500));
+}
+
 void MainProgram::test_common_parent_of_regions()
 {
     if (random_regions_added_ > 0) // Don't do anything if there's no regions
@@ -995,6 +1550,32 @@ void MainProgram::test_common_parent_of_regions()
     }
 }
 
+void MainProgram::test_common_parents_of_regions()
+{
+    if (random_regions_added_ > 0) // Don't do anything if there's no regions
+    {
+        std::vector<std::pair<RegionID, RegionID>> regionpairs(100);
+        for (auto& regionpair : regionpairs)
+        {
+            regionpair.first = n_to_regionid(random<decltype(random_regions_added_)>(0, random_regions_added_));
+            regionpair.second = n_to_regionid(random<decltype(random_regions_added_)>(0, random_regions_added_));
+        }
+        ds_.common_parents_of_regions(regionpairs);
+    }
+}
+
+void MainProgram::test_assign_stations_to_regions()
+{
+    ds_.assign_stations_to_regions();
+}
+
+void MainProgram::test_regions_at()
+{
+    int x = random<int>(1, 10000);
+    int y = random<int>(1, 10000);
+    ds_.regions_at({x,y});
+}
+
 MainProgram::CmdResult MainProgram::cmd_route_any(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
 {
     string fromid = *begin++;
@@ -1236,6 +1817,56 @@ void MainProgram::test_route_earliest_arrival()
     }
 }
 
+MainProgram::CmdResult MainProgram::cmd_route_pareto_journeys(std::ostream &output, MatchIter begin, MatchIter end)
+{
+    string fromid = *begin++;
+    string toid = *begin++;
+    string starttimestr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    Time starttime = convert_string_to<Time>(starttimestr);
+    auto journeys = ds_.route_pareto_journeys(fromid, toid, starttime);
+    CmdResultRoute result;
+
+    if (journeys.empty())
+    {
+        output << "No route found!" << endl;
+    }
+    else if (journeys.front().front() == make_tuple(NO_STATION, NO_TRAIN, NO_TIME))
+    {
+        output << "Starting or destination station not found!" << endl;
+    }
+    else
+    {
+        output << journeys.size() << " Pareto-optimal journey(s), fewest trains first:" << endl;
+        for (auto& journey : journeys)
+        {
+            for (auto iter = journey.begin(); iter+1 != journey.end(); ++iter)
+            {
+                auto& [id, trainid, time] = *iter;
+                result.emplace_back(trainid, id, get<0>(*(iter+1)), time, NO_DISTANCE);
+            }
+            auto& [id, trainid, time] = journey.back();
+            result.emplace_back(trainid, id, NO_STATION, time, NO_DISTANCE);
+        }
+    }
+
+    return {ResultType::ROUTE, result};
+}
+
+void MainProgram::test_route_pareto_journeys()
+{
+    if (random_stations_added_ > 0)
+    {
+        // Choose two random stations
+        auto id1 = n_to_stationid(random<decltype(random_stations_added_)>(0, random_stations_added_));
+        auto id2 = n_to_stationid(random<decltype(random_stations_added_)>(0, random_stations_added_));
+        auto hours = random(0, 24);
+        auto minutes = random(0, 60);
+        ds_.route_pareto_journeys(id1, id2, 100*hours+minutes);
+    }
+}
+
 MainProgram::CmdResult MainProgram::cmd_clear_trains(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
 {
     assert( begin == end && "Impossible number of parameters!");
@@ -1246,6 +1877,35 @@ MainProgram::CmdResult MainProgram::cmd_clear_trains(std::ostream& output, MainP
     return {};
 }
 
+MainProgram::CmdResult MainProgram::cmd_remove_train(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    TrainID trainid = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    bool success = ds_.remove_train(trainid);
+    if (success)
+    {
+        output << "Train " << trainid << " removed." << endl;
+        view_dirty = true;
+    }
+    else
+    {
+        output << "Removing train failed!" << endl;
+    }
+
+    return {};
+}
+
+void MainProgram::test_remove_train()
+{
+    // Choose random number to remove
+    if (random_trains_added_ > 0) // Don't remove if there's nothing to remove
+    {
+        auto trainid = n_to_trainid(random<decltype(random_trains_added_)>(0, random_trains_added_));
+        ds_.remove_train(trainid);
+    }
+}
+
 MainProgram::CmdResult MainProgram::cmd_randseed(std::ostream& output, MatchIter begin, MatchIter end)
 {
     string seedstr = *begin++;
@@ -1292,6 +1952,410 @@ MainProgram::CmdResult MainProgram::cmd_read(std::ostream& output, MatchIter beg
     return {};
 }
 
+// A nonempty line of a data file parsed for cmd_load(). The add_* commands are
+// parsed into their parameters, other lines are kept as text and run as commands.
+// IDs and names point into the file, strings are only made when the record is applied.
+struct MainProgram::LoadRecord
+{
+    CmdResult(MainProgram::*func)(std::ostream& output, MatchIter begin, MatchIter end) = nullptr; // The add_* command, nullptr for other lines
+    string_view line;
+    string_view station;
+    string_view train;
+    string_view name;
+    RegionID region = NO_REGION;
+    RegionID parent = NO_REGION;
+    Coord xy = NO_COORD;
+    Time time = NO_TIME;
+    vector<Coord> coords;
+    std::size_t firstStop = 0; // The stops of an add_train are LoadBatch::stops[firstStop] ... [firstStop+stopCount-1]
+    std::size_t stopCount = 0;
+};
+
+// Parsed lines of a part of a data file, and how many stations, regions and trains they add
+struct MainProgram::LoadBatch
+{
+    vector<LoadRecord> records;
+    vector<pair<string_view, Time>> stops; // Stops of every add_train in the batch
+    unsigned int stations = 0;
+    unsigned int regions = 0;
+    unsigned int trains = 0;
+};
+
+// Consecutive add_station, add_departure or add_train records waiting to be added with a single call
+struct MainProgram::LoadRun
+{
+    CmdResult(MainProgram::*func)(std::ostream& output, MatchIter begin, MatchIter end) = nullptr;
+    vector<tuple<StationID, Name, Coord>> stations;
+    vector<tuple<StationID, TrainID, Time>> departures;
+    vector<pair<TrainID, vector<pair<StationID, Time>>>> trains;
+};
+
+MainProgram::CmdResult MainProgram::cmd_load(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string filename = *begin++;
+    string parallelstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    MappedFile file(filename);
+    if (!file.is_open())
+    {
+        output << "Cannot open file '" << filename << "'!" << endl;
+        return {};
+    }
+
+    string_view text = file.text();
+
+    // In parallel mode the file is split at line boundaries into a chunk per thread,
+    // leaving out threads that would parse less than MIN_CHUNK bytes
+    const std::size_t MIN_CHUNK = 1 << 16;
+    std::size_t chunks = 1;
+    if (!parallelstr.empty())
+    {
+        chunks = clamp<std::size_t>(text.size() / MIN_CHUNK, 1, max(1u, thread::hardware_concurrency()));
+    }
+
+    // Only parsing is done in parallel, the batches are added in file order so that
+    // the results are the same as when reading the file a line at a time
+    vector<LoadBatch> batches(chunks);
+    vector<thread> threads;
+    std::size_t chunkbegin = 0;
+    for (std::size_t i = 0; i < chunks; ++i)
+    {
+        std::size_t chunkend = text.size();
+        if (i + 1 < chunks)
+        {
+            chunkend = min(text.find('\n', max(chunkbegin, text.size() / chunks * (i + 1))), text.size());
+        }
+        string_view chunk = text.substr(chunkbegin, chunkend - chunkbegin);
+        chunkbegin = min(chunkend + 1, text.size());
+
+        if (i + 1 < chunks)
+        {
+            threads.emplace_back(&MainProgram::parse_lines, chunk, ref(batches[i]));
+        }
+        else
+        {
+            parse_lines(chunk, batches[i]);
+        }
+    }
+    for (auto& worker : threads)
+    {
+        worker.join();
+    }
+
+    unsigned int stations = 0;
+    unsigned int regions = 0;
+    unsigned int trains = 0;
+    for (auto const& batch : batches)
+    {
+        stations += batch.stations;
+        regions += batch.regions;
+        trains += batch.trains;
+    }
+    ds_.reserve(stations, regions, trains);
+
+    ostringstream dummystr; // Output of the other commands is discarded like in silent mode
+    unsigned int count = 0;
+    unsigned int failed = 0;
+    bool quit = false;
+    LoadRun run;
+    for (auto& batch : batches)
+    {
+        for (auto& record : batch.records)
+        {
+            ++count;
+            if (record.func != run.func)
+            {
+                failed += apply_run(run);
+            }
+
+            if (add_to_run(record, batch, run))
+            {
+                continue;
+            }
+
+            if (record.func != nullptr)
+            {
+                if (!apply_record(record)) { ++failed; }
+            }
+            else if (!command_parse_line(string(record.line), dummystr))
+            {
+                quit = true;
+                break;
+            }
+        }
+        if (quit) { break; }
+    }
+    failed += apply_run(run);
+
+    output << "** Loaded " << count << " commands from '" << filename << "'";
+    if (failed > 0) { output << ", " << failed << " additions failed"; }
+    output << endl;
+
+    view_dirty = true;
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_save_snapshot(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string filename = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    ofstream file(filename, std::ios::binary);
+    if (!file || !ds_.save_snapshot(file))
+    {
+        output << "Cannot write file '" << filename << "'!" << endl;
+        return {};
+    }
+
+    output << "** Saved snapshot to '" << filename << "'" << endl;
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_load_snapshot(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string filename = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    MappedFile file(filename);
+    if (!file.is_open())
+    {
+        output << "Cannot open file '" << filename << "'!" << endl;
+        return {};
+    }
+
+    if (!ds_.load_snapshot(file.text()))
+    {
+        output << "File '" << filename << "' is not a valid snapshot!" << endl;
+        return {};
+    }
+
+    output << "** Loaded snapshot from '" << filename << "'" << endl;
+
+    view_dirty = true;
+    return {};
+}
+
+/**
+ * @brief MainProgram::parse_lines Parses the nonempty lines of a part of a data file. Safe to call from several threads.
+ * @param text Lines to parse
+ * @param batch Batch the parsed lines are added to
+ */
+void MainProgram::parse_lines(string_view text, LoadBatch& batch)
+{
+    string_view cmd;
+    string_view params;
+    for (std::size_t pos = 0; pos < text.size(); )
+    {
+        auto eol = min(text.find('\n', pos), text.size());
+        string_view line = text.substr(pos, eol - pos);
+        pos = eol + 1;
+
+        if (line.empty()) { continue; }
+
+        batch.records.emplace_back();
+        LoadRecord& record = batch.records.back();
+        record.line = line;
+
+        split_command(line, cmd, params);
+        std::size_t stops = batch.stops.size();
+        auto cmdpos = find_if(cmds_.begin(), cmds_.end(), [cmd](CmdInfo const& ci) { return ci.cmd == cmd; });
+        if (cmdpos == cmds_.end() || params.find_first_of("\r\n") != string_view::npos || !parse_record(*cmdpos, params, record, batch))
+        {
+            // Run through command_parse_line() instead
+            record = LoadRecord();
+            record.line = line;
+            batch.stops.resize(stops);
+            continue;
+        }
+
+        record.func = cmdpos->func;
+        if (record.func == &MainProgram::cmd_add_station) { ++batch.stations; }
+        else if (record.func == &MainProgram::cmd_add_region) { ++batch.regions; }
+        else if (record.func == &MainProgram::cmd_add_train) { ++batch.trains; }
+    }
+}
+
+/**
+ * @brief MainProgram::parse_record Parses the parameters of an add_* command
+ * @param cmd Command
+ * @param params Parameters of the command
+ * @param record Record the parameters are stored to
+ * @param batch Batch of the record, the stops of an add_train are stored to it
+ * @return False if the command has to be run through command_parse_line() instead
+ */
+bool MainProgram::parse_record(CmdInfo const& cmd, string_view params, LoadRecord& record, LoadBatch& batch)
+{
+    auto func = cmd.func;
+    if (func != &MainProgram::cmd_add_station && func != &MainProgram::cmd_add_departure && func != &MainProgram::cmd_add_region &&
+        func != &MainProgram::cmd_add_subregion_to_region && func != &MainProgram::cmd_add_station_to_region &&
+        func != &MainProgram::cmd_add_train)
+    {
+        return false;
+    }
+
+    Matches match;
+    std::size_t count = 0;
+    if (!ParamScanner(params).match(cmd.param_pattern, match, count))
+    {
+        return false;
+    }
+
+    if (func == &MainProgram::cmd_add_station)
+    {
+        if (!parse_number(match[2].text, record.xy.x) || !parse_number(match[3].text, record.xy.y)) { return false; }
+        record.station = match[0].text;
+        record.name = match[1].text;
+    }
+    else if (func == &MainProgram::cmd_add_departure)
+    {
+        if (!parse_number(match[2].text, record.time)) { return false; }
+        record.station = match[0].text;
+        record.train = match[1].text;
+    }
+    else if (func == &MainProgram::cmd_add_region)
+    {
+        if (!parse_number(match[0].text, record.region)) { return false; }
+
+        Matches coord;
+        ParamScanner scanner(match[2].text);
+        while (scanner.next(coordx, coord))
+        {
+            record.coords.emplace_back();
+            if (!parse_number(coord[0].text, record.coords.back().x) || !parse_number(coord[1].text, record.coords.back().y)) { return false; }
+        }
+        if (record.coords.size() < 3) { return false; }
+
+        record.name = match[1].text;
+    }
+    else if (func == &MainProgram::cmd_add_subregion_to_region)
+    {
+        if (!parse_number(match[0].text, record.region) || !parse_number(match[1].text, record.parent)) { return false; }
+    }
+    else if (func == &MainProgram::cmd_add_station_to_region)
+    {
+        if (!parse_number(match[1].text, record.region)) { return false; }
+        record.station = match[0].text;
+    }
+    else
+    {
+        Matches stationtime;
+        ParamScanner scanner(match[1].text);
+        record.firstStop = batch.stops.size();
+        while (scanner.next(stationtimex, stationtime))
+        {
+            Time time;
+            if (!parse_number(stationtime[1].text, time)) { return false; }
+            batch.stops.emplace_back(stationtime[0].text, time);
+        }
+        record.stopCount = batch.stops.size() - record.firstStop;
+        if (record.stopCount < 2) { return false; }
+
+        record.train = match[0].text;
+    }
+
+    return true;
+}
+
+/**
+ * @brief MainProgram::apply_record Adds the data of a parsed add_region, add_subregion_to_region or add_station_to_region to the datastructure
+ * @param record Parsed command, its coordinates are moved away
+ * @return Was the addition successful?
+ */
+bool MainProgram::apply_record(LoadRecord& record)
+{
+    auto func = record.func;
+    if (func == &MainProgram::cmd_add_region)
+    {
+        return ds_.add_region(record.region, Name(record.name), std::move(record.coords));
+    }
+    else if (func == &MainProgram::cmd_add_subregion_to_region)
+    {
+        return ds_.add_subregion_to_region(record.region, record.parent);
+    }
+    else
+    {
+        return ds_.add_station_to_region(StationID(record.station), record.region);
+    }
+}
+
+/**
+ * @brief MainProgram::add_to_run Adds a parsed add_station, add_departure or add_train to the run of such records
+ * @param record Parsed command, its function has to match the run
+ * @param batch Batch of the record
+ * @param run Run the record is added to
+ * @return False if the record isn't one of the commands added in runs
+ */
+bool MainProgram::add_to_run(LoadRecord const& record, LoadBatch const& batch, LoadRun& run)
+{
+    auto func = record.func;
+    if (func == &MainProgram::cmd_add_station)
+    {
+        run.stations.emplace_back(StationID(record.station), Name(record.name), record.xy);
+    }
+    else if (func == &MainProgram::cmd_add_departure)
+    {
+        run.departures.emplace_back(StationID(record.station), TrainID(record.train), record.time);
+    }
+    else if (func == &MainProgram::cmd_add_train)
+    {
+        auto first = batch.stops.begin() + record.firstStop;
+        vector<pair<StationID, Time>> stationtimes;
+        stationtimes.reserve(record.stopCount);
+        for (auto stop = first; stop != first + record.stopCount; ++stop)
+        {
+            stationtimes.emplace_back(StationID(stop->first), stop->second);
+        }
+        run.trains.emplace_back(TrainID(record.train), std::move(stationtimes));
+    }
+    else
+    {
+        return false;
+    }
+
+    run.func = func;
+    return true;
+}
+
+/**
+ * @brief MainProgram::apply_run Adds a run of records to the datastructure with a single call.
+ * If the run is rejected, its records are added one at a time instead, so that the
+ * results are the same as when reading the file a line at a time.
+ * @param run Run to add, it is left empty
+ * @return Number of additions that failed
+ */
+unsigned int MainProgram::apply_run(LoadRun& run)
+{
+    unsigned int failed = 0;
+    if (!run.stations.empty() && !ds_.add_stations(run.stations))
+    {
+        for (auto const& [id, name, xy] : run.stations)
+        {
+            if (!ds_.add_station(id, name, xy)) { ++failed; }
+        }
+    }
+    if (!run.departures.empty() && !ds_.add_departures(run.departures))
+    {
+        for (auto const& [stationid, trainid, time] : run.departures)
+        {
+            if (!ds_.add_departure(stationid, trainid, time)) { ++failed; }
+        }
+    }
+    if (!run.trains.empty() && !ds_.add_trains(run.trains))
+    {
+        for (auto const& [trainid, stationtimes] : run.trains)
+        {
+            if (!ds_.add_train(trainid, stationtimes)) { ++failed; }
+        }
+    }
+
+    // The capacity is kept for the next run
+    run.func = nullptr;
+    run.stations.clear();
+    run.departures.clear();
+    run.trains.clear();
+    return failed;
+}
 
 MainProgram::CmdResult MainProgram::cmd_testread(std::ostream& output, MatchIter begin, MatchIter end)
 {
@@ -1436,6 +2500,42 @@ MainProgram::CmdResult MainProgram::cmd_stopwatch(std::ostream& output, MatchIte
     return {};
 }
 
+MainProgram::CmdResult MainProgram::cmd_ordering_mode(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string incremental = *begin++;
+    string rebuild = *begin++;
+    string sort = *begin++;
+    string radix = *begin++;
+    assert(begin == end && "Invalid number of parameters");
+
+    if (!incremental.empty())
+    {
+        ds_.set_ordering_mode(Datastructures::OrderingMode::INCREMENTAL);
+        output << "Ordering mode: incremental" << endl;
+    }
+    else if (!rebuild.empty())
+    {
+        ds_.set_ordering_mode(Datastructures::OrderingMode::REBUILD);
+        output << "Ordering mode: rebuild" << endl;
+    }
+    else if (!sort.empty())
+    {
+        ds_.set_ordering_mode(Datastructures::OrderingMode::SORT);
+        output << "Ordering mode: sort" << endl;
+    }
+    else if (!radix.empty())
+    {
+        ds_.set_ordering_mode(Datastructures::OrderingMode::RADIX);
+        output << "Ordering mode: radix" << endl;
+    }
+    else
+    {
+        assert(!"Impossible ordering mode!");
+    }
+
+    return {};
+}
+
 std::string MainProgram::print_station_name(StationID id, std::ostream &output, bool nl)
 {
     try
@@ -1536,23 +2636,12 @@ string MainProgram::print_time(Time time, std::ostream &output, bool nl)
     }
 }
 
-string const stationidx = "([a-zA-Z0-9-]+)";
-string const trainidx = "([a-zA-Z0-9-]+)";
-string const regionidx = "([0-9]+)";
-string const namex = "([ a-zA-Z0-9-]+)";
-string const timex = "((?:[01][0-9][0-5][0-9])|(?:2[0-3][0-5][0-9]))";
-string const numx = "([0-9]+)";
-string const optcoordx = "\\([[:space:]]*[0-9]+[[:space:]]*,[[:space:]]*[0-9]+[[:space:]]*\\)";
-string const coordx = "\\([[:space:]]*([0-9]+)[[:space:]]*,[[:space:]]*([0-9]+)[[:space:]]*\\)";
-string const wsx = "[[:space:]]+";
-string const optstationtimeidx = "[a-zA-Z0-9-]+:(?:(?:[01][0-9][0-5][0-9])|(?:2[0-3][0-5][0-9]))";
-
 vector<MainProgram::CmdInfo> MainProgram::cmds_ =
 {
     {"station_count", "", "", &MainProgram::cmd_station_count, nullptr },
     {"clear_all", "", "", &MainProgram::cmd_clear_all, nullptr },
     {"all_stations", "", "", &MainProgram::cmd_all_stations, &MainProgram::test_all_stations },
-    {"add_station", "StationID \"Name\" (x,y)", stationidx+wsx+'"'+namex+'"'+wsx+coordx, &MainProgram::cmd_add_station, nullptr },
+    {"add_station", "StationID \"Name\" (x,y)", stationidx+wsx+namex+wsx+coordx, &MainProgram::cmd_add_station, nullptr },
     {"station_info", "StationID", stationidx, &MainProgram::cmd_station_info, &MainProgram::test_station_info },
     {"stations_alphabetically", "", "", &MainProgram::NoParListCmd<&Datastructures::stations_alphabetically>, &MainProgram::NoParListTestCmd<&Datastructures::stations_alphabetically> },
     {"stations_distance_increasing", "", "", &MainProgram::NoParListCmd<&Datastructures::stations_distance_increasing>,
@@ -1564,7 +2653,7 @@ vector<MainProgram::CmdInfo> MainProgram::cmds_ =
     {"station_departures_after", "StationID Time", stationidx+wsx+timex, &MainProgram::cmd_station_departures_after, &MainProgram::test_station_departures_after },
 //    {"mindist", "", "", &MainProgram::NoParstationCmd<&Datastructures::min_distance>, &MainProgram::NoParstationTestCmd<&Datastructures::min_distance> },
 //    {"maxdist", "", "", &MainProgram::NoParstationCmd<&Datastructures::max_distance>, &MainProgram::NoParstationTestCmd<&Datastructures::max_distance> },
-    {"add_region", "RegionID \"Name\" (x,y) (x,y)...", regionidx+wsx+'"'+namex+'"'+"((?:"+wsx+optcoordx+")+)", &MainProgram::cmd_add_region, nullptr },
+    {"add_region", "RegionID \"Name\" (x,y) (x,y)...", regionidx+wsx+namex+"("+wsx+coordx+"{"+wsx+coordx+"})", &MainProgram::cmd_add_region, nullptr },
     {"all_regions", "", "", &MainProgram::cmd_all_regions, nullptr },
     {"region_info", "RegionID", regionidx, &MainProgram::cmd_region_info, &MainProgram::test_region_info },
     {"add_subregion_to_region", "SubregionID RegionID", regionidx+wsx+regionidx, &MainProgram::cmd_add_subregion_to_region, nullptr },
@@ -1572,30 +2661,41 @@ vector<MainProgram::CmdInfo> MainProgram::cmds_ =
     {"station_in_regions", "StationID", stationidx, &MainProgram::cmd_station_in_regions, &MainProgram::test_station_in_regions },
     {"all_subregions_of_region", "RegionID", regionidx, &MainProgram::cmd_all_subregions_of_region, &MainProgram::test_all_subregions_of_region },
     {"stations_closest_to", "(x,y)", coordx, &MainProgram::cmd_stations_closest_to, &MainProgram::test_stations_closest_to },
+    {"stations_closest_k", "(x,y) k", coordx+wsx+numx, &MainProgram::cmd_stations_closest_k, &MainProgram::test_stations_closest_k },
+    {"stations_within_radius", "(x,y) radius", coordx+wsx+numx, &MainProgram::cmd_stations_within_radius, &MainProgram::test_stations_within_radius },
     {"remove_station", "StationID", stationidx, &MainProgram::cmd_remove_station, &MainProgram::test_remove_station },
     {"common_parent_of_regions", "RegionID1 RegionID2", regionidx+wsx+regionidx, &MainProgram::cmd_common_parent_of_regions, &MainProgram::test_common_parent_of_regions },
-    {"add_train", "TrainID StationID1:Time1 ... StationIDlast:Timelast", trainidx+"((?:"+wsx+optstationtimeidx+")+)", &MainProgram::cmd_add_train, nullptr },
+    {"common_parents_of_regions", "RegionID1:RegionID2 ...", "("+regionpairx+"{"+wsx+regionpairx+"})", &MainProgram::cmd_common_parents_of_regions, &MainProgram::test_common_parents_of_regions },
+    {"assign_stations_to_regions", "", "", &MainProgram::cmd_assign_stations_to_regions, &MainProgram::test_assign_stations_to_regions },
+    {"regions_at", "(x,y)", coordx, &MainProgram::cmd_regions_at, &MainProgram::test_regions_at },
+    {"add_train", "TrainID StationID1:Time1 ... StationIDlast:Timelast", trainidx+"("+wsx+stationtimex+"{"+wsx+stationtimex+"})", &MainProgram::cmd_add_train, nullptr },
     {"next_stations_from", "StationID", stationidx, &MainProgram::cmd_next_stations_from, &MainProgram::test_next_stations_from },
     {"train_stations_from", "StationID TrainID", stationidx+wsx+trainidx, &MainProgram::cmd_train_stations_from, &MainProgram::test_train_stations_from },
     {"clear_trains", "", "", &MainProgram::cmd_clear_trains, nullptr },
+    {"remove_train", "TrainID", trainidx, &MainProgram::cmd_remove_train, &MainProgram::test_remove_train },
     {"route_any", "StationID StationID", stationidx+wsx+stationidx, &MainProgram::cmd_route_any, &MainProgram::test_route_any },
     {"route_least_stations", "StationID StationID", stationidx+wsx+stationidx, &MainProgram::cmd_route_least_stations, &MainProgram::test_route_least_stations },
     {"route_with_cycle", "StationID", stationidx, &MainProgram::cmd_route_with_cycle, &MainProgram::test_route_with_cycle },
     {"route_shortest_distance", "StationID StationID", stationidx+wsx+stationidx, &MainProgram::cmd_route_shortest_distance, &MainProgram::test_route_shortest_distance },
     {"route_earliest_arrival", "StationID StationID StartTime", stationidx+wsx+stationidx+wsx+timex, &MainProgram::cmd_route_earliest_arrival, &MainProgram::test_route_earliest_arrival },
+    {"route_pareto_journeys", "StationID StationID StartTime", stationidx+wsx+stationidx+wsx+timex, &MainProgram::cmd_route_pareto_journeys, &MainProgram::test_route_pareto_journeys },
     {"quit", "", "", nullptr, nullptr },
     {"help", "", "", &MainProgram::help_command, nullptr },
     {"random_stations", "number_of_stations_to_add  (minx,miny) (maxx,maxy) (coordinates optional)",
-     numx+"(?:"+wsx+coordx+wsx+coordx+")?", &MainProgram::cmd_random_stations, &MainProgram::test_random_stations },
+     numx+"["+wsx+coordx+wsx+coordx+"]", &MainProgram::cmd_random_stations, &MainProgram::test_random_stations },
     {"random_trains", "max_number_of_trains_to_add", numx,
      &MainProgram::cmd_random_trains, &MainProgram::test_random_trains },
-    {"read", "\"in-filename\" [silent]", "\"([-a-zA-Z0-9 ./:_]+)\"(?:"+wsx+"(silent))?", &MainProgram::cmd_read, nullptr },
-    {"testread", "\"in-filename\" \"out-filename\"", "\"([-a-zA-Z0-9 ./:_]+)\""+wsx+"\"([-a-zA-Z0-9 ./:_]+)\"", &MainProgram::cmd_testread, nullptr },
+    {"read", "\"in-filename\" [silent]", filenamex+"["+wsx+"('silent')]", &MainProgram::cmd_read, nullptr },
+    {"testread", "\"in-filename\" \"out-filename\"", filenamex+wsx+filenamex, &MainProgram::cmd_testread, nullptr },
+    {"load", "\"in-filename\" [parallel]", filenamex+"["+wsx+"('parallel')]", &MainProgram::cmd_load, nullptr },
+    {"save_snapshot", "\"out-filename\"", filenamex, &MainProgram::cmd_save_snapshot, nullptr },
+    {"load_snapshot", "\"in-filename\"", filenamex, &MainProgram::cmd_load_snapshot, nullptr },
     {"perftest", "cmd1|all|compulsory[;cmd2...] timeout repeat_count n1[;n2...] (parts in [] are optional, alternatives separated by |)",
-     "([0-9a-zA-Z_]+(?:;[0-9a-zA-Z_]+)*)"+wsx+numx+wsx+numx+wsx+"([0-9]+(?:;[0-9]+)*)", &MainProgram::cmd_perftest, nullptr },
-    {"stopwatch", "on|off|next (alternatives separated by |)", "(?:(on)|(off)|(next))", &MainProgram::cmd_stopwatch, nullptr },
+     "(w{';'w})"+wsx+numx+wsx+numx+wsx+"(n{';'n})", &MainProgram::cmd_perftest, nullptr },
+    {"stopwatch", "on|off|next (alternatives separated by |)", "('on')|('off')|('next')", &MainProgram::cmd_stopwatch, nullptr },
+    {"ordering_mode", "incremental|rebuild|sort|radix (alternatives separated by |)", "('incremental')|('rebuild')|('sort')|('radix')", &MainProgram::cmd_ordering_mode, nullptr },
     {"random_seed", "new-random-seed-integer", numx, &MainProgram::cmd_randseed, nullptr },
-    {"#", "comment text", ".*", &MainProgram::cmd_comment, nullptr },
+    {"#", "comment text", "*", &MainProgram::cmd_comment, nullptr },
 };
 
 MainProgram::CmdResult MainProgram::help_command(std::ostream& output, MatchIter /*begin*/, MatchIter /*end*/)
@@ -1618,10 +2718,11 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
     try {
     // Note: everything below is indented too little by one indentation level! (because of try block above)
 
-    vector<string> optional_cmds({"route_least_stations", "route_with_cycle", "route_shortest_distance", "route_earliest_arrival"});
+    vector<string> optional_cmds({"route_least_stations", "route_with_cycle", "route_shortest_distance", "route_earliest_arrival", "route_pareto_journeys"});
     vector<string> nondefault_cmds({"station_count","all_stations","station_info","stations_alphabetically","stations_distance_increasing","find_station_with_coord",
                                     "change_station_coord","add_departure","remove_departure","region_info","station_in_regions","all_subregions_of_region",
-                                    "stations_closest_to","remove_station","common_parent_of_regions"});
+                                    "stations_closest_to","stations_closest_k","stations_within_radius","remove_station","common_parent_of_regions","common_parents_of_regions",
+                                    "assign_stations_to_regions","regions_at","remove_train"});
 
     string commandstr = *begin++;
     unsigned int timeout = convert_string_to<unsigned int>(*begin++);
@@ -1634,22 +2735,20 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
     if (commandstr != "all" && commandstr != "compulsory")
     {
         additional_get_cmds = false;
-        smatch scmd;
-        auto cbeg = commandstr.cbegin();
-        auto cend = commandstr.cend();
-        for ( ; regex_search(cbeg, cend, scmd, commands_regex_); cbeg = scmd.suffix().first)
+        Matches scmd;
+        ParamScanner scanner(commandstr);
+        while (scanner.next("w[';']", scmd))
         {
-            testcmds.push_back(scmd[1]);
+            testcmds.push_back(scmd[0]);
         }
     }
 
     vector<unsigned int> init_ns;
-    smatch size;
-    auto sbeg = sizes.cbegin();
-    auto send = sizes.cend();
-    for ( ; regex_search(sbeg, send, size, sizes_regex_); sbeg = size.suffix().first)
+    Matches size;
+    ParamScanner scanner(sizes);
+    while (scanner.next(numx+"[';']", size))
     {
-        init_ns.push_back(convert_string_to<unsigned int>(size[1]));
+        init_ns.push_back(convert_string_to<unsigned int>(size[0]));
     }
 
     output << "Timeout for each N is " << timeout << " sec. " << endl;
@@ -1886,25 +2985,21 @@ bool MainProgram::command_parse_line(string inputline, ostream& output)
 
     if (inputline.empty()) { return true; }
 
-    smatch match;
-    bool matched = regex_match(inputline, match, cmds_regex_);
-    if (matched)
-    {
-        assert(match.size() == 3);
-        string cmd = match[1];
-        string params = match[2];
-
-        auto pos = find_if(cmds_.begin(), cmds_.end(), [cmd](CmdInfo const& ci) { return ci.cmd == cmd; });
-        assert(pos != cmds_.end());
+    // Parameters may not contain line breaks
+    string_view cmd;
+    string_view params;
+    split_command(inputline, cmd, params);
 
-        smatch match2;
-        bool matched2 = regex_match(params, match2, pos->param_regex);
-        if (matched2)
+    auto pos = find_if(cmds_.begin(), cmds_.end(), [cmd](CmdInfo const& ci) { return ci.cmd == cmd; });
+    if (pos != cmds_.end() && params.find_first_of("\r\n") == string_view::npos)
+    {
+        Matches match;
+        std::size_t count = 0;
+        bool matched = ParamScanner(params).match(pos->param_pattern, match, count);
+        if (matched)
         {
             if (pos->func)
             {
-                assert(!match2.empty());
-
                 Stopwatch stopwatch;
                 bool use_stopwatch = (stopwatch_mode != StopwatchMode::OFF);
                 // Reset stopwatch mode if only for the next command
@@ -1921,7 +3016,7 @@ bool MainProgram::command_parse_line(string inputline, ostream& output)
                 CmdResult result;
                 try
                 {
-                    result = (this->*(pos->func))(output, ++(match2.begin()), match2.end());
+                    result = (this->*(pos->func))(output, match.cbegin(), match.cbegin() + count);
                 }
                 catch (NotImplemented const& e)
                 {
@@ -2195,7 +3290,6 @@ MainProgram::MainProgram()
     //    startmem = get<0>(mempeak());
 
     init_primes();
-    init_regexs();
 }
 
 int MainProgram::mainprogram(int argc, char* argv[])
@@ -2290,24 +3384,3 @@ Coord MainProgram::n_to_coord(unsigned long n)
 
     return {static_cast<int>(hash % 1000), static_cast<int>((hash/1000) % 1000)};
 }
-
-void MainProgram::init_regexs()
-{
-    // Create regex <whitespace>(cmd1|cmd2|...)<whitespace>(.*)
-    string cmds_regex_str = "[[:space:]]*(";
-    bool first = true;
-    for (auto& cmd : cmds_)
-    {
-        cmds_regex_str += (first ? "" : "|") + cmd.cmd;
-        first = false;
-
-        cmd.param_regex = regex(cmd.param_regex_str+"[[:space:]]*", std::regex_constants::ECMAScript | std::regex_constants::optimize);
-    }
-    cmds_regex_str += ")(?:[[:space:]]*$|"+wsx+"(.*))";
-    cmds_regex_ = regex(cmds_regex_str, std::regex_constants::ECMAScript | std::regex_constants::optimize);
-    coords_regex_ = regex(coordx+"[[:space:]]?", std::regex_constants::ECMAScript | std::regex_constants::optimize);
-    stationtimes_regex_ = regex(stationidx+":"+timex+"[[:space:]]?", std::regex_constants::ECMAScript | std::regex_constants::optimize);
-    times_regex_ = regex(wsx+"([0-9][0-9]):([0-9][0-9]):([0-9][0-9])", std::regex_constants::ECMAScript | std::regex_constants::optimize);
-    commands_regex_ = regex("([0-9a-zA-Z_]+);?", std::regex_constants::ECMAScript | std::regex_constants::optimize);
-    sizes_regex_ = regex(numx+";?", std::regex_constants::ECMAScript | std::regex_constants::optimize);
-}
@@ -11,7 +11,7 @@
 
 #include <string>
 #include <random>
-#include <regex>
+#include <string_view>
 #include <chrono>
 #include <sstream>
 #include <stdexcept>
@@ -85,25 +85,31 @@ private:
 
     TestStatus test_status_ = TestStatus::NOT_RUN;
 
-    using MatchIter = std::smatch::const_iterator;
+    // Parameter text captured by the command scanner, empty if its optional part was missing
+    struct Match
+    {
+        std::string_view text;
+        operator std::string() const { return std::string(text); }
+    };
+    using Matches = std::array<Match, 8>;
+    using MatchIter = Matches::const_iterator;
+    class ParamScanner;
+    class MappedFile;
+    struct LoadRecord;
+    struct LoadBatch;
+    struct LoadRun;
+    static void split_command(std::string_view line, std::string_view& cmd, std::string_view& params);
+    template <typename To>
+    static bool parse_number(std::string_view text, To& result);
     struct CmdInfo
     {
         std::string cmd;
         std::string info;
-        std::string param_regex_str;
+        std::string param_pattern;
         CmdResult(MainProgram::*func)(std::ostream& output, MatchIter begin, MatchIter end);
         void(MainProgram::*testfunc)();
-        std::regex param_regex = {};
     };
     static std::vector<CmdInfo> cmds_;
-    // Regex objects and their initialization
-    std::regex cmds_regex_;
-    std::regex coords_regex_;
-    std::regex stationtimes_regex_;
-    std::regex times_regex_;
-    std::regex commands_regex_;
-    std::regex sizes_regex_;
-    void init_regexs();
 
 
     CmdResult cmd_station_count(std::ostream& output, MatchIter begin, MatchIter end);
@@ -124,17 +130,24 @@ private:
     CmdResult cmd_station_in_regions(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_all_subregions_of_region(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_stations_closest_to(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_stations_closest_k(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_stations_within_radius(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_remove_station(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_common_parent_of_regions(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_common_parents_of_regions(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_assign_stations_to_regions(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_regions_at(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_add_train(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_next_stations_from(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_train_stations_from(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_clear_trains(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_remove_train(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_route_any(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_route_least_stations(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_route_with_cycle(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_route_shortest_distance(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_route_earliest_arrival(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_route_pareto_journeys(std::ostream& output, MatchIter begin, MatchIter end);
 
     CmdResult help_command(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_randseed(std::ostream& output, MatchIter begin, MatchIter end);
@@ -142,7 +155,16 @@ private:
     CmdResult cmd_random_trains(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_read(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_testread(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_load(std::ostream& output, MatchIter begin, MatchIter end);
+    static void parse_lines(std::string_view text, LoadBatch& batch);
+    static bool parse_record(CmdInfo const& cmd, std::string_view params, LoadRecord& record, LoadBatch& batch);
+    bool apply_record(LoadRecord& record);
+    static bool add_to_run(LoadRecord const& record, LoadBatch const& batch, LoadRun& run);
+    unsigned int apply_run(LoadRun& run);
+    CmdResult cmd_save_snapshot(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_load_snapshot(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_stopwatch(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_ordering_mode(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_perftest(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_comment(std::ostream& output, MatchIter begin, MatchIter end);
 
@@ -158,15 +180,22 @@ private:
     void test_station_in_regions();
     void test_all_subregions_of_region();
     void test_stations_closest_to();
+    void test_stations_closest_k();
+    void test_stations_within_radius();
     void test_remove_station();
     void test_common_parent_of_regions();
+    void test_common_parents_of_regions();
+    void test_assign_stations_to_regions();
+    void test_regions_at();
     void test_next_stations_from();
     void test_train_stations_from();
+    void test_remove_train();
     void test_route_any();
     void test_route_least_stations();
     void test_route_with_cycle();
     void test_route_shortest_distance();
     void test_route_earliest_arrival();
+    void test_route_pareto_journeys();
     void test_random_stations();
     void test_random_trains();
 
@@ -200,22 +200,9 @@ void MainWindow::update_view()
             assert(!"Unhandled result type in update_view()!");
         }
 
-        auto stations = mainprg_.ds_.all_stations();
-        if (stations.size() == 1 && stations.front() == NO_STATION)
-        {
-            errorset.insert("all_stations() returned error {NO_STATION}");
-        }
-
         if (ui->stations_checkbox->isChecked())
         {
-            auto stations = mainprg_.ds_.all_stations();
-            if (stations.size() == 1 && stations.front() == NO_STATION)
-            {
-                errorset.insert("Error from GUI: all_stations() returned error {NO_STATION}");
-                stations.clear(); // Clear the stations so that no more errors are caused by NO_STATION
-            }
-
-            for (auto stationid : stations)
+            for (auto& stationid : mainprg_.ds_.all_stations_view())
             {
                 QColor stationcolor = Qt::gray;
                 QColor namecolor = Qt::cyan;
@@ -373,7 +360,7 @@ void MainWindow::update_view()
                                 regioncolor = Qt::green;
                                 regionzvalue = -2;
                             }
-                            auto coords = mainprg_.ds_.get_region_coords(regionid);
+                            auto coords = mainprg_.ds_.get_region_coords_view(regionid).value_or(Datastructures::View<const Coord*>());
                             if (coords.size() < 3)
                             {
                                 errorset.insert("get_region_coordinates() returned too few coordinates (under 3)");